@@ -0,0 +1,128 @@
+/**********************************************
+ * Test: adaptive quantum
+ * a cpu bound thread gets a quantum the switch
+ * cost is a small share of, a thread that gives
+ * the cpu up after runs of a known length gets a
+ * quantum that fits them, and quantums stay in
+ * their bounds.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define MIN_QUANTUM 20
+#define MAX_QUANTUM 20000
+#define OVERHEAD 1
+#define BURST_USECS 2000
+#define BURSTS 50
+
+uthread_sem_t sem;
+volatile bool stop = false;
+uthread_thread_stats_t yielder_stats;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+void hog()
+{
+    while (!stop)
+    {
+    }
+}
+
+/* runs for BURST_USECS at a time, then gives the cpu up */
+void yielder()
+{
+    for (int i = 0; i < BURSTS; i++)
+    {
+        long start = now_us();
+        while (now_us() - start < BURST_USECS)
+        {
+        }
+        uthread_yield();
+    }
+    uthread_thread_stats(uthread_get_tid(), &yielder_stats);
+    uthread_sem_post(&sem);
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = 1000;
+    attr.wall_clock = 1;
+    attr.quantum_min_usecs = MAX_QUANTUM + 1;
+    attr.quantum_max_usecs = MAX_QUANTUM;
+    if (uthread_init_attr(&attr) != -1)
+    {
+        error("a minimum above the maximum was accepted");
+    }
+    attr.quantum_min_usecs = MIN_QUANTUM;
+    attr.overhead_percent = 100;
+    if (uthread_init_attr(&attr) != -1)
+    {
+        error("an overhead of 100 percent was accepted");
+    }
+    attr.overhead_percent = OVERHEAD;
+    attr.tickless = 1;
+    if (uthread_init_attr(&attr) != -1)
+    {
+        error("the adaptive quantum was accepted in tickless mode");
+    }
+    attr.tickless = 0;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+    uthread_sem_init(&sem, 0);
+
+    int h = uthread_spawn(hog);
+    uthread_spawn(yielder);
+    uthread_sem_wait(&sem);
+
+    // read while the hog still runs, it ends once stop is set
+    uthread_thread_stats_t hog_stats;
+    uthread_stats_t stats;
+    if (uthread_thread_stats(h, &hog_stats) == -1)
+    {
+        error("the hog ended before its stats were read");
+    }
+    uthread_stats(&stats);
+    stop = true;
+    long hog_quantum = hog_stats.quantum_usecs;
+    long yielder_quantum = yielder_stats.quantum_usecs;
+    long cost = stats.switch_cost_avg_nsecs;
+    printf("switch cost %ld ns, hog quantum %ld us, yielder quantum %ld us\n", cost, hog_quantum, yielder_quantum);
+    if (hog_quantum < MIN_QUANTUM || hog_quantum > MAX_QUANTUM || yielder_quantum < MIN_QUANTUM
+        || yielder_quantum > MAX_QUANTUM)
+    {
+        error("a quantum is out of its bounds");
+    }
+    if (cost <= 0 || cost * 100 > hog_quantum * 1000L * OVERHEAD * 2)
+    {
+        error("the switch cost is more than the target share of the quantum of a cpu bound thread");
+    }
+    if (yielder_quantum < BURST_USECS * 3 / 2 || hog_quantum * 2 > yielder_quantum)
+    {
+        error("the quantum of a thread did not fit its runs");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,203 @@
+/**********************************************
+ * Test: per-thread arena allocator
+ * threads allocating while they are preempted
+ * keep their blocks intact, blocks are aligned
+ * and reused, blocks freed by another thread go
+ * back to their arena, and the arena of a
+ * terminated thread is unmapped.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <unistd.h>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define ALLOCATORS 8
+#define ROUNDS 200
+#define LIVE_BLOCKS 64
+#define HANDED_BLOCKS 100
+#define HOARD_BLOCKS 2000
+
+int finished = 0;
+void *handed[HANDED_BLOCKS];
+bool handed_ready = false;
+bool handed_freed = false;
+bool hoarded = false;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+/* @return the size of the process's mappings in bytes */
+long mapped_bytes()
+{
+    long size = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == nullptr || fscanf(f, "%ld", &size) != 1)
+    {
+        error("could not read /proc/self/statm");
+    }
+    fclose(f);
+    return size * sysconf(_SC_PAGESIZE);
+}
+
+/* allocates blocks of many sizes, small and mapped on their own, filled with
+ * a pattern of the thread that is checked before they are freed */
+void allocator()
+{
+    int me = uthread_get_tid();
+    unsigned int seed = me;
+    unsigned char *blocks[LIVE_BLOCKS] = {};
+    size_t sizes[LIVE_BLOCKS] = {};
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        for (int i = 0; i < LIVE_BLOCKS; i++)
+        {
+            if (blocks[i] != nullptr)
+            {
+                for (size_t j = 0; j < sizes[i]; j++)
+                {
+                    if (blocks[i][j] != (unsigned char) (me + i + j))
+                    {
+                        error("a block changed while its thread did not write it");
+                    }
+                }
+                uthread_free(blocks[i]);
+            }
+            sizes[i] = rand_r(&seed) % 8 == 0 ? rand_r(&seed) % 20000 : rand_r(&seed) % 300;
+            blocks[i] = (unsigned char *) uthread_malloc(sizes[i]);
+            if (blocks[i] == nullptr || (uintptr_t) blocks[i] % 16 != 0)
+            {
+                error("uthread_malloc returned no block or a block not aligned to 16");
+            }
+            for (size_t j = 0; j < sizes[i]; j++)
+            {
+                blocks[i][j] = (unsigned char) (me + i + j);
+            }
+        }
+    }
+    for (int i = 0; i < LIVE_BLOCKS; i++)
+    {
+        uthread_free(blocks[i]);
+    }
+    finished++;
+}
+
+/* hands blocks to the main thread to free, and takes them back */
+void lender()
+{
+    for (int i = 0; i < HANDED_BLOCKS; i++)
+    {
+        handed[i] = uthread_malloc(100);
+    }
+    handed_ready = true;
+    while (!handed_freed)
+    {
+        uthread_yield();
+    }
+    for (int i = 0; i < HANDED_BLOCKS; i++)
+    {
+        void *block = uthread_malloc(100);
+        bool found = false;
+        for (int j = 0; j < HANDED_BLOCKS && !found; j++)
+        {
+            found = block == handed[j];
+        }
+        if (!found)
+        {
+            error("a block freed by another thread was not reused by its own");
+        }
+    }
+    finished++;
+}
+
+/* allocates and is terminated without freeing */
+void hoarder()
+{
+    for (int i = 0; i < HOARD_BLOCKS; i++)
+    {
+        uthread_malloc(i % 2 == 0 ? 1000 : 10000);
+    }
+    hoarded = true;
+    for (;;)
+    {
+        uthread_yield();
+    }
+}
+
+int main()
+{
+    if (uthread_malloc(16) != nullptr)
+    {
+        error("uthread_malloc before init returned a block");
+    }
+    uthread_attr attr = {};
+    attr.quantum_usecs = 1000;
+    attr.wall_clock = 1;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+
+    void *a = uthread_malloc(40);
+    uthread_free(a);
+    if (uthread_malloc(33) != a)
+    {
+        error("a freed block of the same size class was not reused");
+    }
+    uthread_free(nullptr);
+
+    // allocations cut by preemption
+    for (int i = 0; i < ALLOCATORS; i++)
+    {
+        uthread_spawn(allocator);
+    }
+    while (finished < ALLOCATORS)
+    {
+        uthread_yield();
+    }
+
+    // blocks freed by another thread
+    finished = 0;
+    uthread_spawn(lender);
+    while (!handed_ready)
+    {
+        uthread_yield();
+    }
+    for (int i = 0; i < HANDED_BLOCKS; i++)
+    {
+        uthread_free(handed[i]);
+    }
+    handed_freed = true;
+    while (finished < 1)
+    {
+        uthread_yield();
+    }
+
+    // the arena goes away with its thread
+    long before = mapped_bytes();
+    int tid = uthread_spawn(hoarder);
+    while (!hoarded)
+    {
+        uthread_yield();
+    }
+    long grown = mapped_bytes() - before;
+    uthread_terminate(tid);
+    long left = mapped_bytes() - before;
+    printf("arena of the terminated thread: %ld bytes, %ld left after it\n", grown, left);
+    if (grown < HOARD_BLOCKS / 2 * 10000L || left > grown / 100)
+    {
+        error("the arena of a terminated thread was not unmapped");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,93 @@
+/**********************************************
+ * Benchmark: arena allocator against malloc with
+ * the timer signal blocked around each call, the
+ * way a thread had to allocate before. threads
+ * allocate and free small blocks while they are
+ * preempted, and it prints the pairs per second.
+ * usage: bench_arena [pairs_per_thread] [threads]
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <ctime>
+#include "../uthreads.h"
+
+#define LIVE_BLOCKS 32
+
+long pairs = 0;
+int finished = 0;
+sigset_t timer_signal;
+
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void *masked_malloc(size_t size)
+{
+    sigprocmask(SIG_BLOCK, &timer_signal, nullptr);
+    void *p = malloc(size);
+    sigprocmask(SIG_UNBLOCK, &timer_signal, nullptr);
+    return p;
+}
+
+void masked_free(void *p)
+{
+    sigprocmask(SIG_BLOCK, &timer_signal, nullptr);
+    free(p);
+    sigprocmask(SIG_UNBLOCK, &timer_signal, nullptr);
+}
+
+template <void *(*alloc)(size_t), void (*release)(void *)>
+void churn()
+{
+    void *blocks[LIVE_BLOCKS] = {};
+    for (long i = 0; i < pairs; i++)
+    {
+        int slot = (int) (i % LIVE_BLOCKS);
+        release(blocks[slot]);
+        blocks[slot] = alloc(16 + (i * 7) % 240);
+    }
+    for (int i = 0; i < LIVE_BLOCKS; i++)
+    {
+        release(blocks[i]);
+    }
+    finished++;
+}
+
+double run(thread_entry_point entry, int threads)
+{
+    finished = 0;
+    long long start = now_ns();
+    for (int i = 0; i < threads; i++)
+    {
+        uthread_spawn(entry);
+    }
+    while (finished < threads)
+    {
+        uthread_yield();
+    }
+    return pairs * threads * 1e9 / (now_ns() - start);
+}
+
+int main(int argc, char **argv)
+{
+    pairs = argc > 1 ? atol(argv[1]) : 1000000;
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+
+    uthread_attr attr = {};
+    attr.quantum_usecs = 1000;
+    attr.wall_clock = 1;
+    uthread_init_attr(&attr);
+    sigemptyset(&timer_signal);
+    sigaddset(&timer_signal, SIGALRM);
+
+    double masked = run(churn<masked_malloc, masked_free>, threads);
+    double arena = run(churn<uthread_malloc, uthread_free>, threads);
+    printf("threads=%d pairs=%ld masked_malloc_pairs_per_sec=%.0f arena_pairs_per_sec=%.0f\n", threads,
+           pairs * threads, masked, arena);
+    uthread_terminate(0);
+}
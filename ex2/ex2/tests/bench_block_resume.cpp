@@ -0,0 +1,73 @@
+/**********************************************
+ * Benchmark: block/resume of ready threads
+ * the main thread repeatedly blocks and resumes
+ * every spawned thread while they all sit in the
+ * READY queue, and reports the cost per call.
+ * usage: bench_block_resume [threads] [rounds]
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "../uthreads.h"
+
+#define MAX_THREADS 10000
+
+void idle()
+{
+    while (true)
+    {}
+}
+
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    int num_threads = argc > 1 ? atoi(argv[1]) : 5000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 100;
+
+    /* a long quantum so the main thread keeps the CPU while measuring */
+    uthread_attr attr = {};
+    attr.quantum_usecs = 1000000;
+    attr.max_threads = num_threads < MAX_THREADS ? MAX_THREADS : num_threads + 1;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    int spawned = 0;
+    while (spawned < num_threads && uthread_spawn(idle) != -1)
+    {
+        spawned++;
+    }
+
+    long long start = now_ns();
+    for (int r = 0; r < rounds; r++)
+    {
+        /* block from the middle of the queue outwards to defeat any
+         * front/back shortcut */
+        for (int i = spawned / 2; i >= 1; i--)
+        {
+            uthread_block(i);
+        }
+        for (int i = spawned / 2 + 1; i <= spawned; i++)
+        {
+            uthread_block(i);
+        }
+        for (int i = 1; i <= spawned; i++)
+        {
+            uthread_resume(i);
+        }
+    }
+    long long total = now_ns() - start;
+    long long ops = 2LL * rounds * spawned;
+
+    printf("threads=%d rounds=%d ops=%lld ns_per_op=%.1f\n",
+           spawned, rounds, ops, ops ? (double) total / ops : 0.0);
+    uthread_terminate(0);
+}
@@ -0,0 +1,77 @@
+/**********************************************
+ * Benchmark: channel ping-pong
+ * two threads pass a counter back and forth over
+ * a pair of channels. the main thread waits on a
+ * third channel, so only the two players run.
+ * usage: bench_chan [round_trips] [capacity] [workers]
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "../uthreads.h"
+
+uthread_chan *ping;
+uthread_chan *pong;
+uthread_chan *done;
+long round_trips = 0;
+
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void pinger()
+{
+    long n = 0;
+    long long start = now_ns();
+    for (long i = 0; i < round_trips; i++)
+    {
+        uthread_chan_send(ping, &n);
+        uthread_chan_recv(pong, &n);
+    }
+    long long elapsed = now_ns() - start;
+    uthread_chan_send(done, &elapsed);
+}
+
+void ponger()
+{
+    long n;
+    while (uthread_chan_recv(ping, &n) == 1)
+    {
+        n++;
+        uthread_chan_send(pong, &n);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    round_trips = argc > 1 ? atol(argv[1]) : 200000;
+    int capacity = argc > 2 ? atoi(argv[2]) : 0;
+    int workers = argc > 3 ? atoi(argv[3]) : 1;
+
+    uthread_attr attr = {};
+    attr.quantum_usecs = 100000;
+    attr.workers = workers;
+    uthread_init_attr(&attr);
+    ping = uthread_chan_create(sizeof(long), capacity);
+    pong = uthread_chan_create(sizeof(long), capacity);
+    done = uthread_chan_create(sizeof(long long), 1);
+    uthread_spawn(ponger);
+    uthread_spawn(pinger);
+
+    long long elapsed;
+    uthread_chan_recv(done, &elapsed);
+
+#ifdef UTHREADS_FAST_SWITCH
+    const char *backend = "fast";
+#else
+    const char *backend = "sigjmp";
+#endif
+    double ns = (double) elapsed / round_trips;
+    printf("backend=%s capacity=%d workers=%d round_trips=%ld ns_per_round_trip=%.1f messages_per_sec=%.0f\n",
+           backend, capacity, workers, round_trips, ns, 2e9 / ns);
+    uthread_terminate(0);
+}
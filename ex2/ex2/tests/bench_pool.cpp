@@ -0,0 +1,83 @@
+/**********************************************
+ * Benchmark: task pool against a thread per task
+ * runs small tasks in batches, once as a spawned
+ * and joined thread each and once on the workers
+ * of a pool, and prints the tasks per second.
+ * usage: bench_pool [tasks] [pool_workers] [batch]
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "../uthreads.h"
+
+long counter = 0;
+
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void *task(void *arg)
+{
+    counter++;
+    return arg;
+}
+
+int main(int argc, char **argv)
+{
+    long tasks = argc > 1 ? atol(argv[1]) : 200000;
+    int pool_workers = argc > 2 ? atoi(argv[2]) : 4;
+    int batch = argc > 3 ? atoi(argv[3]) : 64;
+
+    uthread_attr attr = {};
+    attr.quantum_usecs = 100000;
+    attr.max_threads = batch + pool_workers + 1;
+    uthread_init_attr(&attr);
+    int *tids = new int[batch];
+    uthread_future **futures = new uthread_future *[batch];
+
+    long long start = now_ns();
+    for (long done = 0; done < tasks; done += batch)
+    {
+        for (int i = 0; i < batch; i++)
+        {
+            tids[i] = uthread_spawn_arg(task, nullptr);
+        }
+        for (int i = 0; i < batch; i++)
+        {
+            uthread_join(tids[i], nullptr);
+        }
+    }
+    long long spawn_ns = now_ns() - start;
+
+    uthread_pool *pool = uthread_pool_create(pool_workers);
+    start = now_ns();
+    for (long done = 0; done < tasks; done += batch)
+    {
+        for (int i = 0; i < batch; i++)
+        {
+            futures[i] = uthread_pool_submit(pool, task, nullptr);
+        }
+        for (int i = 0; i < batch; i++)
+        {
+            uthread_future_get(futures[i], nullptr);
+        }
+    }
+    long long pool_ns = now_ns() - start;
+    uthread_pool_destroy(pool);
+
+#ifdef UTHREADS_FAST_SWITCH
+    const char *backend = "fast";
+#else
+    const char *backend = "sigjmp";
+#endif
+    long ran = (tasks + batch - 1) / batch * batch;
+    printf("backend=%s tasks=%ld batch=%d spawn_tasks_per_sec=%.0f pool_workers=%d pool_tasks_per_sec=%.0f\n",
+           backend, ran, batch, ran * 1e9 / spawn_ns, pool_workers, ran * 1e9 / pool_ns);
+    delete[] tids;
+    delete[] futures;
+    uthread_terminate(0);
+}
@@ -0,0 +1,118 @@
+/**********************************************
+ * Benchmark: shared stack against a stack per
+ * thread. spawns idle threads waiting on a
+ * semaphore and measures the resident memory
+ * they add, then the cost of a switch between
+ * two threads that yield to each other. each
+ * mode runs in a child process of its own.
+ * usage: bench_shared_stack [threads] [switches]
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../uthreads.h"
+
+uthread_sem_t sem;
+uthread_sem_t done;
+long switches = 0;
+long long elapsed = 0;
+int players_done = 0;
+
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* @return the resident memory of the process in bytes */
+long resident_bytes()
+{
+    long size = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == nullptr || fscanf(f, "%ld %ld", &size, &resident) != 2)
+    {
+        resident = 0;
+    }
+    if (f != nullptr)
+    {
+        fclose(f);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+void idle()
+{
+    uthread_sem_wait(&sem);
+}
+
+void player()
+{
+    long long start = now_ns();
+    for (long i = 0; i < switches / 2; i++)
+    {
+        uthread_yield();
+    }
+    if (players_done++ == 0)
+    {
+        elapsed = now_ns() - start;
+        uthread_sem_post(&done);
+    }
+}
+
+void run(int shared, int threads)
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = 1000000;
+    attr.max_threads = threads + 3;
+    attr.shared_stack = shared;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        exit(1);
+    }
+    uthread_sem_init(&sem, 0);
+    uthread_sem_init(&done, 0);
+
+    long before = resident_bytes();
+    for (int i = 0; i < threads; i++)
+    {
+        uthread_spawn(idle);
+    }
+    uthread_yield();
+    long per_thread = (resident_bytes() - before) / threads;
+
+    uthread_spawn(player);
+    uthread_spawn(player);
+    uthread_sem_wait(&done);
+
+#ifdef UTHREADS_FAST_SWITCH
+    const char *backend = "fast";
+#else
+    const char *backend = "sigjmp";
+#endif
+    printf("backend=%s stack=%s threads=%d bytes_per_idle_thread=%ld ns_per_switch=%.1f\n", backend,
+           shared ? "shared" : "dedicated", threads, per_thread, (double) elapsed / (switches / 2 * 2));
+    fflush(stdout);
+    uthread_terminate(0);
+}
+
+int main(int argc, char **argv)
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 100000;
+    switches = argc > 2 ? atol(argv[2]) : 1000000;
+
+    for (int shared = 0; shared <= 1; shared++)
+    {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            run(shared, threads);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    return 0;
+}
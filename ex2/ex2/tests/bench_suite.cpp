@@ -0,0 +1,390 @@
+/**********************************************
+ * Benchmark suite: the same workloads on uthreads
+ * and on pthreads, one JSON object per line.
+ *   ring         a token passed around a ring of
+ *                threads over semaphores, with 2
+ *                threads it is the switch latency
+ *   spawn        spawn and join a thread that
+ *                returns at once, in batches
+ *   block_resume resume a thread that blocks
+ *                itself again (pthreads: a flag
+ *                under a mutex and condition)
+ *   sleep        wake-up delay past the requested
+ *                sleep, p50 / p99 / max
+ * build it as bench_suite (sigsetjmp backend),
+ * bench_suite_fast (UTHREADS_FAST_SWITCH) and
+ * bench_suite_pthread (BENCH_PTHREADS).
+ * usage: bench_suite [scale]
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <algorithm>
+#include <vector>
+
+#define QUANTUM_USECS 1000
+#define SLEEP_QUANTUMS 2
+#define SPAWN_BATCH 64
+#define MAX_RING 1024
+
+#ifdef BENCH_PTHREADS
+#include <pthread.h>
+#include <semaphore.h>
+
+const char *impl = "pthreads";
+typedef pthread_t bench_thread;
+typedef sem_t bench_sem;
+
+void bench_init()
+{
+}
+
+bench_thread bench_spawn(void *(*fn)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 65536);
+    pthread_t t;
+    if (pthread_create(&t, &attr, fn, arg) != 0)
+    {
+        perror("pthread_create");
+        exit(1);
+    }
+    pthread_attr_destroy(&attr);
+    return t;
+}
+
+void bench_join(bench_thread t)
+{
+    pthread_join(t, nullptr);
+}
+
+void bench_sem_init(bench_sem *sem)
+{
+    sem_init(sem, 0, 0);
+}
+
+void bench_sem_wait(bench_sem *sem)
+{
+    sem_wait(sem);
+}
+
+void bench_sem_post(bench_sem *sem)
+{
+    sem_post(sem);
+}
+
+void bench_sleep()
+{
+    struct timespec ts = {0, SLEEP_QUANTUMS * QUANTUM_USECS * 1000L};
+    nanosleep(&ts, nullptr);
+}
+
+/* a parked flag under a mutex and condition, the pthreads way to let one
+ * thread stop another until it is resumed */
+pthread_mutex_t park_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t park_cond = PTHREAD_COND_INITIALIZER;
+bool parked = false;
+
+void bench_block_self()
+{
+    pthread_mutex_lock(&park_mutex);
+    parked = true;
+    pthread_cond_broadcast(&park_cond);
+    while (parked)
+    {
+        pthread_cond_wait(&park_cond, &park_mutex);
+    }
+    pthread_mutex_unlock(&park_mutex);
+}
+
+/* resumes the parked thread and waits until it parks again */
+void bench_resume_round_trip(bench_thread)
+{
+    pthread_mutex_lock(&park_mutex);
+    parked = false;
+    pthread_cond_broadcast(&park_cond);
+    while (!parked)
+    {
+        pthread_cond_wait(&park_cond, &park_mutex);
+    }
+    pthread_mutex_unlock(&park_mutex);
+}
+
+/* waits until the spawned thread parked the first time */
+void bench_wait_blocked(bench_thread)
+{
+    pthread_mutex_lock(&park_mutex);
+    while (!parked)
+    {
+        pthread_cond_wait(&park_cond, &park_mutex);
+    }
+    pthread_mutex_unlock(&park_mutex);
+}
+
+/* lets the thread go for good */
+void bench_release(bench_thread t)
+{
+    pthread_mutex_lock(&park_mutex);
+    parked = false;
+    pthread_cond_broadcast(&park_cond);
+    pthread_mutex_unlock(&park_mutex);
+    (void) t;
+}
+#else
+#include "../uthreads.h"
+
+#ifdef UTHREADS_FAST_SWITCH
+const char *impl = "uthreads-fast";
+#else
+const char *impl = "uthreads-sigjmp";
+#endif
+typedef int bench_thread;
+typedef uthread_sem_t bench_sem;
+
+void bench_init()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = QUANTUM_USECS;
+    attr.wall_clock = 1;
+    attr.max_threads = MAX_RING + SPAWN_BATCH + 2;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        exit(1);
+    }
+}
+
+bench_thread bench_spawn(void *(*fn)(void *), void *arg)
+{
+    int tid = uthread_spawn_arg(fn, arg);
+    if (tid == -1)
+    {
+        exit(1);
+    }
+    return tid;
+}
+
+void bench_join(bench_thread t)
+{
+    uthread_join(t, nullptr);
+}
+
+void bench_sem_init(bench_sem *sem)
+{
+    uthread_sem_init(sem, 0);
+}
+
+void bench_sem_wait(bench_sem *sem)
+{
+    uthread_sem_wait(sem);
+}
+
+void bench_sem_post(bench_sem *sem)
+{
+    uthread_sem_post(sem);
+}
+
+void bench_sleep()
+{
+    uthread_sleep(SLEEP_QUANTUMS);
+}
+
+long wakeups = 0;
+
+void bench_block_self()
+{
+    uthread_block(uthread_get_tid());
+    wakeups++;
+}
+
+/* resumes the blocked thread, which runs until it blocks itself again. if it
+ * was preempted before it blocked, the resume had no effect and is repeated */
+void bench_resume_round_trip(bench_thread t)
+{
+    long before = wakeups;
+    do
+    {
+        uthread_resume(t);
+        uthread_yield();
+    } while (wakeups == before);
+}
+
+void bench_wait_blocked(bench_thread)
+{
+    uthread_yield();
+}
+
+void bench_release(bench_thread t)
+{
+    bench_resume_round_trip(t);
+}
+#endif
+
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void report(const char *bench, int threads, long ops, long long elapsed_ns)
+{
+    printf("{\"impl\":\"%s\",\"bench\":\"%s\",\"threads\":%d,\"ops\":%ld,\"ns_per_op\":%.1f,\"ops_per_sec\":%.0f}\n",
+           impl, bench, threads, ops, (double) elapsed_ns / ops, ops * 1e9 / elapsed_ns);
+    fflush(stdout);
+}
+
+/* ring */
+
+bench_sem ring[MAX_RING];
+int ring_size = 0;
+long hops = 0;
+long ring_target = 0;
+
+void *ring_member(void *arg)
+{
+    int i = (int) (intptr_t) arg;
+    bench_sem *next = &ring[(i + 1) % ring_size];
+    for (;;)
+    {
+        bench_sem_wait(&ring[i]);
+        if (hops >= ring_target)
+        {
+            // pass the end on, so that every member wakes up once more
+            bench_sem_post(next);
+            return nullptr;
+        }
+        hops++;
+        bench_sem_post(next);
+    }
+}
+
+void bench_ring(int size, long target)
+{
+    ring_size = size;
+    ring_target = target;
+    hops = 0;
+    std::vector<bench_thread> members;
+    for (int i = 0; i < size; i++)
+    {
+        bench_sem_init(&ring[i]);
+        members.push_back(bench_spawn(ring_member, (void *) (intptr_t) i));
+    }
+    long long start = now_ns();
+    bench_sem_post(&ring[0]);
+    for (bench_thread t : members)
+    {
+        bench_join(t);
+    }
+    report("ring", size, target, now_ns() - start);
+}
+
+/* spawn */
+
+void *empty(void *arg)
+{
+    return arg;
+}
+
+void bench_spawn_join(long tasks)
+{
+    bench_thread batch[SPAWN_BATCH];
+    long done = 0;
+    long long start = now_ns();
+    while (done < tasks)
+    {
+        for (int i = 0; i < SPAWN_BATCH; i++)
+        {
+            batch[i] = bench_spawn(empty, nullptr);
+        }
+        for (int i = 0; i < SPAWN_BATCH; i++)
+        {
+            bench_join(batch[i]);
+        }
+        done += SPAWN_BATCH;
+    }
+    report("spawn", SPAWN_BATCH, done, now_ns() - start);
+}
+
+/* block_resume */
+
+long round_trips = 0;
+
+void *block_loop(void *)
+{
+    for (long i = 0; i <= round_trips; i++)
+    {
+        bench_block_self();
+    }
+    return nullptr;
+}
+
+void bench_block_resume(long target)
+{
+    round_trips = target;
+    bench_thread t = bench_spawn(block_loop, nullptr);
+    bench_wait_blocked(t);
+    long long start = now_ns();
+    for (long i = 0; i < target; i++)
+    {
+        bench_resume_round_trip(t);
+    }
+    long long elapsed = now_ns() - start;
+    bench_release(t);
+    bench_join(t);
+    report("block_resume", 2, target, elapsed);
+}
+
+/* sleep */
+
+std::vector<long long> sleep_late;
+
+void *sleeper(void *arg)
+{
+    long sleeps = (long) (intptr_t) arg;
+    for (long i = 0; i < sleeps; i++)
+    {
+        long long start = now_ns();
+        bench_sleep();
+        sleep_late.push_back(now_ns() - start - SLEEP_QUANTUMS * QUANTUM_USECS * 1000LL);
+    }
+    return nullptr;
+}
+
+void bench_sleep_jitter(long sleeps)
+{
+    sleep_late.clear();
+    bench_join(bench_spawn(sleeper, (void *) (intptr_t) sleeps));
+    std::sort(sleep_late.begin(), sleep_late.end());
+    long long sum = 0;
+    for (long long late : sleep_late)
+    {
+        sum += late;
+    }
+    printf("{\"impl\":\"%s\",\"bench\":\"sleep\",\"threads\":1,\"ops\":%ld,\"sleep_ns\":%ld,\"late_mean_ns\":%lld,"
+           "\"late_p50_ns\":%lld,\"late_p99_ns\":%lld,\"late_max_ns\":%lld}\n",
+           impl, sleeps, SLEEP_QUANTUMS * QUANTUM_USECS * 1000L, sum / sleeps, sleep_late[sleeps / 2],
+           sleep_late[sleeps * 99 / 100], sleep_late.back());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    long scale = argc > 1 ? atol(argv[1]) : 1;
+    scale = scale > 0 ? scale : 1;
+
+    bench_init();
+    for (int size = 2; size <= MAX_RING; size *= 8)
+    {
+        bench_ring(size, 200000 * scale);
+    }
+    bench_spawn_join(50000 * scale);
+    bench_block_resume(200000 * scale);
+    bench_sleep_jitter(200 * scale);
+#ifndef BENCH_PTHREADS
+    uthread_terminate(0);
+#endif
+    return 0;
+}
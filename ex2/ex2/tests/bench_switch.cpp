@@ -0,0 +1,70 @@
+/**********************************************
+ * Benchmark: thread switch rate
+ * worker threads give up the CPU with
+ * uthread_sleep(1) in a loop. only switches from
+ * one worker straight into another are timed, so
+ * the main thread's busy quantums are left out.
+ * build it as bench_switch (sigsetjmp backend) and
+ * bench_switch_fast (UTHREADS_FAST_SWITCH).
+ * usage: bench_switch [workers] [switches]
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "../uthreads.h"
+
+volatile bool worker_switched = false;
+volatile long long last_ns = 0;
+volatile long long switch_ns = 0;
+volatile long long switches = 0;
+long long target = 0;
+
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void worker()
+{
+    while (true)
+    {
+        worker_switched = true;
+        last_ns = now_ns();
+        uthread_sleep(1);
+        long long t = now_ns();
+        if (worker_switched && switches < target)
+        {
+            switch_ns += t - last_ns;
+            switches++;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int workers = argc > 1 ? atoi(argv[1]) : MAX_THREAD_NUM - 1;
+    target = argc > 2 ? atoll(argv[2]) : 20000;
+
+    uthread_init(1000);
+    for (int i = 0; i < workers; i++)
+    {
+        uthread_spawn(worker);
+    }
+    while (switches < target)
+    {
+        worker_switched = false;
+    }
+
+#ifdef UTHREADS_FAST_SWITCH
+    const char *backend = "fast";
+#else
+    const char *backend = "sigjmp";
+#endif
+    double ns = (double) switch_ns / switches;
+    printf("backend=%s workers=%d switches=%lld ns_per_switch=%.1f switches_per_sec=%.0f\n",
+           backend, workers, (long long) switches, ns, 1e9 / ns);
+    uthread_terminate(0);
+}
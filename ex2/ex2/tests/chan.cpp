@@ -0,0 +1,198 @@
+/**********************************************
+ * Test: channels
+ * unbuffered, buffered and unbounded channels
+ * pass elements in order, waiters are completed
+ * by the peer, close wakes everyone, and select
+ * drops the cases it did not take.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define MANY 1000
+
+struct Point
+{
+    int x;
+    int y;
+};
+
+uthread_chan *a;
+uthread_chan *b;
+int got = 0;
+int ret = 0;
+int select_index = -1;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void receiver()
+{
+    ret = uthread_chan_recv(a, &got);
+}
+
+void sender()
+{
+    int value = 7;
+    ret = uthread_chan_send(a, &value);
+}
+
+void selector()
+{
+    uthread_chan_case cases[2] = {{a, UTHREAD_CHAN_RECV, &got, 0},
+                                  {b, UTHREAD_CHAN_RECV, &got, 0}};
+    select_index = uthread_chan_select(cases, 2, 0);
+    ret = cases[select_index].ok;
+}
+
+int main()
+{
+    // long enough that only the calls below switch threads
+    if (uthread_init(1000000) == -1)
+    {
+        error("init failed");
+    }
+
+    // unbuffered: a waiting receiver gets the element from the sender
+    a = uthread_chan_create(sizeof(int), 0);
+    b = uthread_chan_create(sizeof(int), 0);
+    int r = uthread_spawn(receiver);
+    uthread_yield();
+    int value = 42;
+    if (uthread_chan_send(a, &value) != 0 || got != 42)
+    {
+        error("send to a waiting receiver did not hand the element over");
+    }
+    uthread_yield();
+    if (ret != 1 || uthread_get_quantums(r) != -1)
+    {
+        error("receiver did not finish after one more quantum");
+    }
+
+    // unbuffered: a waiting sender is taken directly
+    uthread_spawn(sender);
+    uthread_yield();
+    if (uthread_chan_recv(a, &value) != 1 || value != 7)
+    {
+        error("receive from a waiting sender failed");
+    }
+    uthread_yield();
+    if (ret != 0)
+    {
+        error("sender failed");
+    }
+
+    // buffered, in order, and full
+    uthread_chan *buffered = uthread_chan_create(sizeof(int), 3);
+    for (int i = 1; i <= 3; i++)
+    {
+        uthread_chan_send(buffered, &i);
+    }
+    value = 4;
+    uthread_chan_case full = {buffered, UTHREAD_CHAN_SEND, &value, 0};
+    if (uthread_chan_select(&full, 1, 1) != 1)
+    {
+        error("send to a full channel did not wait");
+    }
+    for (int i = 1; i <= 3; i++)
+    {
+        if (uthread_chan_recv(buffered, &value) != 1 || value != i)
+        {
+            error("buffered channel out of order");
+        }
+    }
+
+    // unbounded
+    uthread_chan *unbounded = uthread_chan_create(sizeof(int), UTHREAD_CHAN_UNBOUNDED);
+    for (int i = 0; i < MANY; i++)
+    {
+        uthread_chan_send(unbounded, &i);
+    }
+    for (int i = 0; i < MANY; i++)
+    {
+        if (uthread_chan_recv(unbounded, &value) != 1 || value != i)
+        {
+            error("unbounded channel out of order");
+        }
+    }
+
+    // close wakes a receiver, fails a sender, and drains the buffer first
+    got = -1;
+    uthread_spawn(receiver);
+    uthread_yield();
+    uthread_chan_close(a);
+    uthread_yield();
+    if (ret != 0 || got != 0)
+    {
+        error("receiver not woken by close");
+    }
+    a = uthread_chan_create(sizeof(int), 0);
+    uthread_spawn(sender);
+    uthread_yield();
+    uthread_chan_close(a);
+    uthread_yield();
+    if (ret != -1)
+    {
+        error("sender not failed by close");
+    }
+    value = 9;
+    uthread_chan_send(buffered, &value);
+    uthread_chan_close(buffered);
+    if (uthread_chan_recv(buffered, &value) != 1 || value != 9
+        || uthread_chan_recv(buffered, &value) != 0 || value != 0)
+    {
+        error("closed channel was not drained");
+    }
+    if (uthread_chan_send(buffered, &value) != -1)
+    {
+        error("send to a closed channel succeeded");
+    }
+
+    // select takes one case and leaves the other channel
+    a = uthread_chan_create(sizeof(int), 0);
+    uthread_spawn(selector);
+    uthread_yield();
+    value = 5;
+    uthread_chan_send(b, &value);
+    uthread_yield();
+    if (select_index != 1 || ret != 1 || got != 5)
+    {
+        error("select did not take the ready case");
+    }
+    uthread_chan_case left = {a, UTHREAD_CHAN_SEND, &value, 0};
+    if (uthread_chan_select(&left, 1, 1) != 1)
+    {
+        error("select left a waiter behind");
+    }
+
+    // a thread terminated while it waits in select
+    int doomed = uthread_spawn(selector);
+    uthread_yield();
+    uthread_terminate(doomed);
+    if (uthread_chan_destroy(a) != 0 || uthread_chan_destroy(b) != 0)
+    {
+        error("terminated thread still waits on channels");
+    }
+
+    // typed channel
+    uthread_channel<Point> points(UTHREAD_CHAN_UNBOUNDED);
+    Point p = {3, 4};
+    points.send(p);
+    Point q = {0, 0};
+    if (points.recv(q) != 1 || q.x != 3 || q.y != 4)
+    {
+        error("typed channel");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,287 @@
+/**********************************************
+ * Test: stackless tasks
+ * C++20 coroutines spawned as tasks sleep, send
+ * and receive on channels and wait for file
+ * descriptors with co_await, alongside threads
+ * that are preempted, a large fan-out of tasks
+ * needs no stacks, and a terminated task has its
+ * coroutine destroyed.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define SLEEPERS 100
+#define SLEEP_QUANTUMS 3
+#define MESSAGES 1000
+#define FAN_OUT 10000
+
+int finished = 0;
+int destroyed = 0;
+bool stop = false;
+long received = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+/* @return the size of the process's mappings in bytes */
+long mapped_bytes()
+{
+    long size = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == nullptr || fscanf(f, "%ld", &size) != 1)
+    {
+        error("could not read /proc/self/statm");
+    }
+    fclose(f);
+    return size * sysconf(_SC_PAGESIZE);
+}
+
+void wait_finished(int count)
+{
+    while (finished < count)
+    {
+        uthread_yield();
+    }
+}
+
+void hog()
+{
+    while (!stop)
+    {
+    }
+}
+
+uthread_co_task sleeper()
+{
+    int start = uthread_get_total_quantums();
+    co_await uthread_sleep_for(SLEEP_QUANTUMS);
+    if (uthread_get_total_quantums() - start < SLEEP_QUANTUMS)
+    {
+        error("a task woke up before its sleep ended");
+    }
+    finished++;
+}
+
+/* answers every number it receives with the next one, until in is closed */
+uthread_co_task echo(uthread_channel<long> *in, uthread_channel<long> *out)
+{
+    for (;;)
+    {
+        std::optional<long> n = co_await in->recv();
+        if (!n)
+        {
+            break;
+        }
+        if (!co_await out->co_send(*n + 1))
+        {
+            error("co_send failed");
+        }
+    }
+    finished++;
+}
+
+/* doubles one number */
+uthread_co_task doubler(uthread_channel<long> *in, uthread_channel<long> *out)
+{
+    std::optional<long> n = co_await in->recv();
+    co_await out->co_send(*n * 2);
+    finished++;
+}
+
+/* reads one message from a non-blocking pipe */
+uthread_co_task reader(int fd)
+{
+    char buf[16];
+    for (;;)
+    {
+        co_await uthread_fd_readable(fd);
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n > 0)
+        {
+            received = n;
+            break;
+        }
+    }
+    finished++;
+}
+
+int pipe_fds[2];
+
+void writer()
+{
+    uthread_sleep(SLEEP_QUANTUMS);
+    if (write(pipe_fds[1], "stackless", 9) != 9)
+    {
+        error("write to the pipe failed");
+    }
+}
+
+struct Guard {
+    ~Guard() { destroyed++; }
+};
+
+/* waits on a channel no one sends to */
+uthread_co_task forever(uthread_channel<long> *in)
+{
+    Guard guard;
+    co_await in->recv();
+    error("a task waiting on a channel no one sends to woke up");
+}
+
+/* @return whether a stackless task is rejected in a child that initialized
+ * the library with attr */
+bool rejected_in_child(const uthread_attr &attr)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        uthread_attr child_attr = attr;
+        if (uthread_init_attr(&child_attr) == -1)
+        {
+            _exit(2);
+        }
+        _exit(sleeper().spawn() == -1 ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main()
+{
+    if (uthread_co_sleep(1) != -1 || uthread_co_wait_fd(0, 0) != -1)
+    {
+        error("a stackless task hook was accepted before init");
+    }
+
+    uthread_attr attr = {};
+    attr.quantum_usecs = 1000;
+    attr.wall_clock = 1;
+    attr.max_threads = FAN_OUT + 10;
+    attr.workers = 2;
+    if (!rejected_in_child(attr))
+    {
+        error("a stackless task was accepted with 2 workers");
+    }
+    attr.workers = 0;
+    attr.shared_stack = 1;
+    if (!rejected_in_child(attr))
+    {
+        error("a stackless task was accepted on a shared stack");
+    }
+    attr.shared_stack = 0;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+    int ret;
+    long elem = 0;
+    uthread_channel<long> to_task(0), from_task(0);
+    if (uthread_co_sleep(1) != -1 || uthread_co_chan_recv(to_task.get(), &elem, &ret) != -1)
+    {
+        error("a stackless task hook was accepted outside of a task");
+    }
+
+    // sleeps, while a thread that does not yield is preempted
+    uthread_spawn(hog);
+    for (int i = 0; i < SLEEPERS; i++)
+    {
+        if (sleeper().spawn() == -1)
+        {
+            error("spawn of a stackless task failed");
+        }
+    }
+    wait_finished(SLEEPERS);
+    stop = true;
+
+    // a thread and a task talk over channels
+    finished = 0;
+    echo(&to_task, &from_task).spawn();
+    for (long i = 0; i < MESSAGES; i++)
+    {
+        to_task.send(i);
+        if (from_task.recv(elem) != 1 || elem != i + 1)
+        {
+            error("the task did not answer with the next number");
+        }
+    }
+    to_task.close();
+    wait_finished(1);
+
+    // a fan-out of tasks, each waiting on a channel with no stack of its own
+    finished = 0;
+    uthread_channel<long> to_task_fan(0), from_task_fan(FAN_OUT);
+    long before = mapped_bytes();
+    for (int i = 0; i < FAN_OUT; i++)
+    {
+        if (doubler(&to_task_fan, &from_task_fan).spawn() == -1)
+        {
+            error("spawn of the fan-out failed");
+        }
+    }
+    uthread_yield();
+    long grown = mapped_bytes() - before;
+    printf("%d waiting tasks mapped %ld bytes\n", FAN_OUT, grown);
+    if (grown > FAN_OUT * sysconf(_SC_PAGESIZE) / 2)
+    {
+        error("the waiting tasks mapped more than their thread blocks and frames");
+    }
+    long sum = 0;
+    for (long i = 0; i < FAN_OUT; i++)
+    {
+        to_task_fan.send(i);
+    }
+    for (int i = 0; i < FAN_OUT; i++)
+    {
+        from_task_fan.recv(elem);
+        sum += elem;
+    }
+    wait_finished(FAN_OUT);
+    if (sum != (long) FAN_OUT * (FAN_OUT - 1))
+    {
+        error("the fan-out did not double every number");
+    }
+
+    // a task waits for a pipe a thread writes to
+    finished = 0;
+    if (pipe2(pipe_fds, O_NONBLOCK) == -1)
+    {
+        error("pipe failed");
+    }
+    reader(pipe_fds[0]).spawn();
+    uthread_spawn(writer);
+    wait_finished(1);
+    if (received != 9)
+    {
+        error("the task did not read what the thread wrote");
+    }
+
+    // a terminated task has its coroutine destroyed
+    uthread_channel<long> idle(0);
+    int tid = forever(&idle).spawn();
+    uthread_yield();
+    if (uthread_terminate(tid) != 0 || destroyed != 1)
+    {
+        error("the coroutine of a terminated task was not destroyed");
+    }
+    if (forever(&idle).spawn() != tid)
+    {
+        error("the ID of a terminated task was not reused");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
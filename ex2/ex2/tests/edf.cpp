@@ -0,0 +1,147 @@
+/**********************************************
+ * Test: EDF real-time class
+ * the ready EDF thread with the nearest deadline
+ * runs first, a periodic thread meets its deadlines
+ * next to cpu bound threads, and a thread that
+ * overruns its budget is throttled.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define HOGS 5
+#define PERIOD 10
+#define BUDGET 3
+#define PERIODS 10
+#define OVERRUN_BUDGET 2
+#define OVERRUN_QUANTUMS 100
+
+uthread_sem_t sem;
+int order[2];
+int logged = 0;
+int periodic_misses = -1;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void log_tid()
+{
+    order[logged++] = uthread_get_tid();
+}
+
+void hog()
+{
+    while (true)
+    {
+    }
+}
+
+/* runs until one more quantum of its own starts */
+void spin_quantum()
+{
+    int me = uthread_get_tid();
+    int target = uthread_get_quantums(me) + 1;
+    while (uthread_get_quantums(me) < target)
+    {
+    }
+}
+
+void periodic()
+{
+    for (int i = 0; i < PERIODS; i++)
+    {
+        spin_quantum();
+        uthread_wait_period();
+    }
+    periodic_misses = uthread_get_deadline_misses(uthread_get_tid());
+    uthread_sem_post(&sem);
+}
+
+void timer()
+{
+    uthread_sleep(OVERRUN_QUANTUMS);
+    uthread_sem_post(&sem);
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = 5000;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+    uthread_sem_init(&sem, 0);
+
+    if (uthread_set_edf(0, PERIOD, PERIOD + 1) != -1 || uthread_set_edf(0, -1, 0) != -1
+        || uthread_wait_period() != -1)
+    {
+        error("an invalid EDF call succeeded");
+    }
+
+    // the nearest deadline first, whatever the spawn order
+    int far = uthread_spawn(log_tid);
+    int near = uthread_spawn(log_tid);
+    uthread_set_edf(far, 5 * PERIOD, 1);
+    uthread_set_edf(near, PERIOD, 1);
+    uthread_yield();
+    if (logged != 2 || order[0] != near || order[1] != far)
+    {
+        error("EDF threads did not run in deadline order");
+    }
+
+    // a periodic thread next to cpu bound threads, which would leave it one
+    // quantum out of HOGS + 1 under round robin
+    for (int i = 0; i < HOGS; i++)
+    {
+        uthread_spawn(hog);
+    }
+    int p = uthread_spawn(periodic);
+    uthread_set_edf(p, PERIOD, BUDGET);
+    uthread_sem_wait(&sem);
+    if (periodic_misses != 0)
+    {
+        error("a periodic thread missed its deadline");
+    }
+
+    // a thread that never completes its job gets its budget every period
+    int over = uthread_spawn(hog);
+    uthread_set_edf(over, PERIOD, OVERRUN_BUDGET);
+    int start = uthread_get_total_quantums();
+    uthread_spawn(timer);
+    uthread_sem_wait(&sem);
+    int periods = (uthread_get_total_quantums() - start) / PERIOD;
+    int used = uthread_get_quantums(over);
+    if (used > OVERRUN_BUDGET * (periods + 2))
+    {
+        error("an overrunning thread was not throttled");
+    }
+    if (uthread_get_deadline_misses(over) < periods - 1)
+    {
+        error("deadline misses were not counted");
+    }
+
+    // back to round robin
+    if (uthread_set_edf(over, 0, 0) != 0)
+    {
+        error("set_edf with period 0 failed");
+    }
+    uthread_spawn(timer);
+    uthread_sem_wait(&sem);
+    if (uthread_get_quantums(over) == used)
+    {
+        error("a thread that left the EDF class did not run");
+    }
+
+    printf(GRN "SUCCESS - %d quantums in %d periods\n" RESET, used, periods);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/**********************************************
+ * Test: idle process and wall clock mode
+ * when every thread sleeps or waits, the process
+ * waits in the kernel without using the cpu, and
+ * sleeping threads wake up after their quantums
+ * of real time.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define QUANTUM 10000
+#define NAP 20
+
+uthread_sem_t sem;
+int pipe_fds[2];
+int order[3];
+int logged = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+double seconds(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void nap()
+{
+    uthread_sleep(NAP);
+    uthread_sem_post(&sem);
+}
+
+void nap_and_log()
+{
+    int me = uthread_get_tid();
+    uthread_sleep(5 * me);
+    order[logged++] = me;
+    uthread_sem_post(&sem);
+}
+
+void nap_and_write()
+{
+    uthread_sleep(NAP);
+    if (uthread_write(pipe_fds[1], "x", 1) != 1)
+    {
+        error("write failed");
+    }
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = QUANTUM;
+    attr.wall_clock = 1;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+    uthread_sem_init(&sem, 0);
+
+    // main waits for a sleeping thread, nothing runs meanwhile
+    uthread_spawn(nap);
+    double wall = seconds(CLOCK_MONOTONIC);
+    double cpu = seconds(CLOCK_PROCESS_CPUTIME_ID);
+    if (uthread_sem_wait(&sem) == -1)
+    {
+        error("main could not wait for a sleeping thread");
+    }
+    wall = seconds(CLOCK_MONOTONIC) - wall;
+    cpu = seconds(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+    if (wall < NAP * QUANTUM / 1e6 * 0.8 || wall > NAP * QUANTUM / 1e6 * 3)
+    {
+        error("sleep did not last its quantums of real time");
+    }
+    if (cpu > wall / 10)
+    {
+        error("the idle process used the cpu");
+    }
+
+    // sleepers wake up in order of their deadline
+    for (int i = 0; i < 3; i++)
+    {
+        uthread_spawn(nap_and_log);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        uthread_sem_wait(&sem);
+    }
+    if (order[0] != 1 || order[1] != 2 || order[2] != 3)
+    {
+        error("sleepers woke up out of order");
+    }
+
+    // main waits for I/O that a sleeping thread does
+    if (pipe(pipe_fds) == -1)
+    {
+        error("pipe failed");
+    }
+    uthread_spawn(nap_and_write);
+    char c;
+    cpu = seconds(CLOCK_PROCESS_CPUTIME_ID);
+    if (uthread_read(pipe_fds[0], &c, 1) != 1 || c != 'x')
+    {
+        error("read failed");
+    }
+    if (seconds(CLOCK_PROCESS_CPUTIME_ID) - cpu > NAP * QUANTUM / 1e6 / 10)
+    {
+        error("the process used the cpu while waiting for I/O");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
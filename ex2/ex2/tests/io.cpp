@@ -0,0 +1,320 @@
+/**********************************************
+ * Test: uthread_read / uthread_write / uthread_accept
+ * a thread waiting for I/O does not run until its
+ * fd is ready, the process sleeps in epoll when
+ * every thread waits for I/O, a closed fd number
+ * is watched again once it is reused, closing an
+ * fd wakes the thread waiting on it, and a
+ * loopback echo server serves many client threads.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define CLIENTS 20
+#define MESSAGE 32
+#define BIG (4 << 20)
+#define CHUNK 65536
+
+int pair[2];
+char received[MESSAGE];
+int finished = 0;
+
+int port = 0;
+int conns[CLIENTS];
+int accepted = 0;
+int handled = 0;
+int echoed = 0;
+
+long big_sum = 0;
+
+int closed_fd;
+ssize_t closed_ret = 0;
+int closed_errno = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void wait_for(int n)
+{
+    while (finished < n)
+    {
+        uthread_yield();
+    }
+    finished = 0;
+}
+
+void read_pair()
+{
+    if (uthread_read(pair[0], received, sizeof(received)) != 5)
+    {
+        error("read returned the wrong length");
+    }
+    finished++;
+}
+
+/* waits on an fd that is closed under it */
+void read_closed()
+{
+    char buf[MESSAGE];
+    closed_ret = uthread_read(closed_fd, buf, sizeof(buf));
+    closed_errno = errno;
+    finished++;
+}
+
+void handle()
+{
+    int fd = conns[handled++];
+    char buf[MESSAGE];
+    ssize_t n = uthread_read(fd, buf, sizeof(buf));
+    if (n <= 0 || uthread_write(fd, buf, n) != n)
+    {
+        error("echo failed");
+    }
+    uthread_close(fd);
+    finished++;
+}
+
+void serve()
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (listener == -1 || bind(listener, (struct sockaddr *) &addr, len) == -1
+        || listen(listener, CLIENTS) == -1
+        || getsockname(listener, (struct sockaddr *) &addr, &len) == -1)
+    {
+        error("could not listen on loopback");
+    }
+    port = ntohs(addr.sin_port);
+    while (accepted < CLIENTS)
+    {
+        int fd = uthread_accept(listener, nullptr, nullptr);
+        if (fd == -1)
+        {
+            error("accept failed");
+        }
+        conns[accepted++] = fd;
+        if (uthread_spawn(handle) == -1)
+        {
+            error("spawn failed");
+        }
+    }
+    uthread_close(listener);
+    finished++;
+}
+
+void client()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (fd == -1 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+    {
+        error("connect failed");
+    }
+    char out[MESSAGE];
+    char in[MESSAGE];
+    int n = snprintf(out, sizeof(out), "hello from %d", uthread_get_tid());
+    if (uthread_write(fd, out, n) != n)
+    {
+        error("client write failed");
+    }
+    int got = 0;
+    while (got < n)
+    {
+        ssize_t r = uthread_read(fd, in + got, sizeof(in) - got);
+        if (r <= 0)
+        {
+            error("client read failed");
+        }
+        got += r;
+    }
+    if (memcmp(in, out, n) != 0)
+    {
+        error("echo did not match");
+    }
+    echoed++;
+    uthread_close(fd);
+    finished++;
+}
+
+/* writes more than the socket buffer holds, so the writer waits for EPOLLOUT */
+void write_big()
+{
+    static char buf[CHUNK];
+    for (int sent = 0; sent < BIG;)
+    {
+        int size = BIG - sent < CHUNK ? BIG - sent : CHUNK;
+        for (int i = 0; i < size; i++)
+        {
+            buf[i] = (char) (sent + i);
+        }
+        ssize_t n = uthread_write(pair[1], buf, size);
+        if (n <= 0)
+        {
+            error("big write failed");
+        }
+        sent += n;
+    }
+    finished++;
+}
+
+void read_big()
+{
+    static unsigned char buf[CHUNK];
+    for (int got = 0; got < BIG;)
+    {
+        ssize_t n = uthread_read(pair[0], buf, BIG - got < CHUNK ? BIG - got : CHUNK);
+        if (n <= 0)
+        {
+            error("big read failed");
+        }
+        for (ssize_t i = 0; i < n; i++)
+        {
+            big_sum += buf[i];
+        }
+        got += n;
+    }
+    finished++;
+}
+
+int main()
+{
+    // long enough that only the calls below switch threads
+    if (uthread_init(1000000) == -1)
+    {
+        error("init failed");
+    }
+
+    // a reader waits without running until its fd is ready
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+    {
+        error("socketpair failed");
+    }
+    int reader = uthread_spawn(read_pair);
+    uthread_yield();
+    int reader_quantums = uthread_get_quantums(reader);
+    for (int i = 0; i < 5; i++)
+    {
+        uthread_yield();
+    }
+    if (uthread_get_quantums(reader) != reader_quantums || finished != 0)
+    {
+        error("a thread waiting for I/O ran");
+    }
+    if (uthread_write(pair[1], "ping", 5) != 5)
+    {
+        error("write failed");
+    }
+    wait_for(1);
+    if (strcmp(received, "ping") != 0)
+    {
+        error("read the wrong data");
+    }
+
+    // the only thread waits for I/O, so the process sleeps in epoll. the
+    // pipe reuses the fd numbers of the pair, which must be watched again
+    uthread_close(pair[0]);
+    uthread_close(pair[1]);
+    int pipe_fds[2];
+    if (pipe(pipe_fds) == -1)
+    {
+        error("pipe failed");
+    }
+    if (pipe_fds[0] != pair[0])
+    {
+        error("the pipe did not reuse the fd number of the pair");
+    }
+    pid_t child = fork();
+    if (child == 0)
+    {
+        usleep(50000);
+        write(pipe_fds[1], "late", 5);
+        _exit(0);
+    }
+    char late[5];
+    if (uthread_read(pipe_fds[0], late, sizeof(late)) != 5 || strcmp(late, "late") != 0)
+    {
+        error("main did not wait for the pipe");
+    }
+    waitpid(child, nullptr, 0);
+
+    // closing an fd wakes the thread waiting on it
+    closed_fd = pipe_fds[0];
+    uthread_spawn(read_closed);
+    uthread_yield();
+    if (finished != 0)
+    {
+        error("the reader of an empty pipe did not wait");
+    }
+    if (uthread_close(closed_fd) != 0)
+    {
+        error("close failed");
+    }
+    wait_for(1);
+    if (closed_ret != -1 || closed_errno != EBADF)
+    {
+        error("a read of a closed fd did not fail with EBADF");
+    }
+    uthread_close(pipe_fds[1]);
+
+    // loopback echo server
+    uthread_spawn(serve);
+    while (port == 0)
+    {
+        uthread_yield();
+    }
+    for (int i = 0; i < CLIENTS; i++)
+    {
+        if (uthread_spawn(client) == -1)
+        {
+            error("spawn failed");
+        }
+    }
+    wait_for(1 + 2 * CLIENTS);
+    if (echoed != CLIENTS)
+    {
+        error("not every client got its echo");
+    }
+
+    // writes that fill the socket buffer
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+    {
+        error("socketpair failed");
+    }
+    uthread_spawn(write_big);
+    uthread_spawn(read_big);
+    wait_for(2);
+    long expected = 0;
+    for (int i = 0; i < BIG; i++)
+    {
+        expected += (unsigned char) i;
+    }
+    if (big_sum != expected)
+    {
+        error("big transfer lost data");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,149 @@
+/**********************************************
+ * Test: spawn with an argument and join
+ * results are passed back whether the joiner
+ * waits or comes late, a joiner does not use
+ * quantums while it waits, and the ID of a
+ * joinable thread is reused once it is joined.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define SPIN_QUANTUMS 20
+#define LOOPS 1000
+
+bool done = false;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void *twice(void *arg)
+{
+    return (void *) ((intptr_t) arg * 2);
+}
+
+void *twice_and_mark(void *arg)
+{
+    done = true;
+    return twice(arg);
+}
+
+/* runs for SPIN_QUANTUMS quantums of its own */
+void *spin(void *arg)
+{
+    int me = uthread_get_tid();
+    while (uthread_get_quantums(me) <= SPIN_QUANTUMS)
+    {
+    }
+    return arg;
+}
+
+void *block_self(void *arg)
+{
+    uthread_block(uthread_get_tid());
+    return arg;
+}
+
+void plain()
+{
+}
+
+int main()
+{
+    if (uthread_init(5000) == -1)
+    {
+        error("init failed");
+    }
+
+    // the joiner waits for the result
+    void *ret = nullptr;
+    int tid = uthread_spawn_arg(twice, (void *) 21);
+    if (uthread_join(tid, &ret) != 0 || ret != (void *) 42)
+    {
+        error("join did not return the result");
+    }
+    if (uthread_join(tid, &ret) != -1)
+    {
+        error("a thread was joined twice");
+    }
+
+    // the thread ends before it is joined, its ID is kept until then
+    tid = uthread_spawn_arg(twice_and_mark, (void *) 5);
+    while (!done)
+    {
+        uthread_yield();
+    }
+    int other = uthread_spawn_arg(twice, (void *) 1);
+    if (other == tid)
+    {
+        error("the ID of an unjoined thread was reused");
+    }
+    if (uthread_join(tid, &ret) != 0 || ret != (void *) 10 || uthread_join(other, nullptr) != 0)
+    {
+        error("join of a terminated thread failed");
+    }
+
+    // the joiner does not run while it waits
+    tid = uthread_spawn_arg(spin, nullptr);
+    int before = uthread_get_quantums(0);
+    uthread_join(tid, nullptr);
+    if (uthread_get_quantums(0) - before > 2)
+    {
+        error("the joiner used quantums while it waited");
+    }
+
+    // a terminated thread has no result
+    tid = uthread_spawn_arg(block_self, (void *) 7);
+    uthread_yield();
+    uthread_terminate(tid);
+    ret = (void *) 1;
+    if (uthread_join(tid, &ret) != 0 || ret != nullptr)
+    {
+        error("a terminated thread had a result");
+    }
+
+    // stacks and ID's are reused right away
+    int first = uthread_spawn_arg(twice, (void *) 0);
+    uthread_join(first, nullptr);
+    for (intptr_t i = 0; i < LOOPS; i++)
+    {
+        tid = uthread_spawn_arg(twice, (void *) i);
+        if (tid != first || uthread_join(tid, &ret) != 0 || ret != (void *) (2 * i))
+        {
+            error("spawn and join in a loop failed");
+        }
+    }
+
+    // detach
+    tid = uthread_spawn_arg(twice, nullptr);
+    if (uthread_detach(tid) != 0 || uthread_join(tid, nullptr) != -1)
+    {
+        error("a detached thread was joined");
+    }
+    uthread_yield();
+    if (uthread_spawn_arg(twice, nullptr) != tid)
+    {
+        error("the ID of a detached thread was not reused");
+    }
+
+    // errors
+    int p = uthread_spawn(plain);
+    if (uthread_join(0, nullptr) != -1 || uthread_join(-1, nullptr) != -1 || uthread_join(p, nullptr) != -1
+        || uthread_spawn_arg(nullptr, nullptr) != -1 || uthread_detach(p) != -1)
+    {
+        error("an invalid join succeeded");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,85 @@
+/**********************************************
+ * Test: many threads
+ * spawns 100000 threads with a max_threads that
+ * allows it, checks ID's are reused smallest
+ * first, that the threads run, and that idle
+ * threads did not commit their stacks.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define NUM_THREADS 100000
+#define RUN_THREADS 50
+
+volatile int ran = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void idle()
+{
+    ran++;
+    uthread_block(uthread_get_tid());
+}
+
+/* @return the resident set size of the process in MiB */
+long rss_mib()
+{
+    long pages_total, pages_resident;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == nullptr || fscanf(f, "%ld %ld", &pages_total, &pages_resident) != 2)
+        error("can't read /proc/self/statm");
+    fclose(f);
+    return pages_resident * 4096 / (1024 * 1024);
+}
+
+int main()
+{
+    printf(GRN "Test many threads: " RESET);
+    fflush(stdout);
+
+    uthread_attr attr = {};
+    /* a quantum long enough that no thread runs while spawning */
+    attr.quantum_usecs = 1000000;
+    attr.max_threads = NUM_THREADS + 1;
+    uthread_init_attr(&attr);
+
+    for (int i = 1; i <= NUM_THREADS; i++)
+    {
+        if (uthread_spawn(idle) != i)
+            error("wrong id returned");
+    }
+    if (uthread_spawn(idle) != -1)
+        error("spawned past max_threads");
+
+    /* 100000 stacks of STACK_SIZE would be over 6 GiB */
+    if (rss_mib() > 256)
+        error("idle threads committed their stacks");
+
+    uthread_terminate(70000);
+    uthread_terminate(500);
+    uthread_terminate(99999);
+    if (uthread_spawn(idle) != 500 || uthread_spawn(idle) != 70000
+        || uthread_spawn(idle) != 99999)
+        error("ids are not reused smallest first");
+
+    /* let some of them run, the rest stay idle */
+    for (int i = RUN_THREADS + 1; i <= NUM_THREADS; i++)
+    {
+        uthread_block(i);
+    }
+    while (ran < RUN_THREADS)
+    {}
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+}
@@ -0,0 +1,119 @@
+/**********************************************
+ * Test: MLFQ policy
+ * the highest priority READY thread runs first,
+ * a thread that sleeps often gets ahead of cpu
+ * bound threads once they are demoted, and aging
+ * keeps a low priority thread from starving.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define INTERACTIVE_RUNS 40
+
+uthread_sem_t sem;
+int order[3];
+int logged = 0;
+volatile bool hogs_stop = false;
+volatile bool stop = false;
+int interactive_runs = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void log_tid()
+{
+    order[logged++] = uthread_get_tid();
+}
+
+void hog()
+{
+    while (!hogs_stop)
+    {
+    }
+}
+
+void interactive()
+{
+    for (interactive_runs = 0; interactive_runs < INTERACTIVE_RUNS; interactive_runs++)
+    {
+        uthread_sleep(1);
+    }
+    uthread_sem_post(&sem);
+}
+
+void yielder()
+{
+    while (!stop)
+    {
+        uthread_yield();
+    }
+}
+
+void starved()
+{
+    stop = true;
+    uthread_sem_post(&sem);
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = 10000;
+    attr.policy = UTHREAD_POLICY_MLFQ;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+    uthread_sem_init(&sem, 0);
+
+    // strict priority order, the main thread last
+    if (uthread_set_priority(0, UTHREAD_PRIORITIES - 1) == -1)
+    {
+        error("set_priority failed");
+    }
+    int low = uthread_spawn_prio(log_tid, 6);
+    int mid = uthread_spawn_prio(log_tid, 2);
+    int high = uthread_spawn(log_tid);
+    if (uthread_spawn_prio(log_tid, UTHREAD_PRIORITIES) != -1 || uthread_set_priority(0, -1) != -1)
+    {
+        error("an invalid priority was accepted");
+    }
+    uthread_yield();
+    if (logged != 3 || order[0] != high || order[1] != mid || order[2] != low)
+    {
+        error("threads did not run in priority order");
+    }
+
+    // a thread that sleeps every quantum runs every other quantum next to
+    // two demoted cpu bound threads, round robin would give it every third
+    uthread_spawn(hog);
+    uthread_spawn(hog);
+    int start = uthread_get_total_quantums();
+    uthread_spawn(interactive);
+    uthread_sem_wait(&sem);
+    int spent = uthread_get_total_quantums() - start;
+    if (spent > INTERACTIVE_RUNS * 5 / 2)
+    {
+        error("the interactive thread waited behind cpu bound threads");
+    }
+    hogs_stop = true;
+
+    // a priority 0 thread that always yields stays on top, aging lets the
+    // lowest priority thread run anyway
+    uthread_spawn(yielder);
+    uthread_spawn_prio(starved, UTHREAD_PRIORITIES - 1);
+    uthread_sem_wait(&sem);
+
+    printf(GRN "SUCCESS - %d quantums for %d interactive runs\n" RESET, spent, INTERACTIVE_RUNS);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,202 @@
+/**********************************************
+ * Test: M:N mode
+ * threads are spread over several kernel threads
+ * and keep their ID across workers, while the
+ * main thread blocks, resumes and terminates them
+ * and some of them sleep and spawn more threads.
+ * the value of a key of a thread terminated on
+ * another worker is destroyed once it stopped.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <unistd.h>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define WORKERS 4
+#define THREADS 40
+#define CHILDREN 4
+#define WORK 200000000L
+#define CHUNK 50000L
+
+std::atomic<int> finished(0);
+std::atomic<int> spawners(0);
+std::atomic<int> wrong_tid(0);
+std::atomic<int> kernel_tids[WORKERS];
+std::atomic<bool> done[THREADS + CHILDREN + 2];
+
+uthread_key_t key;
+std::atomic<int> destroyed(0);
+std::atomic<long> victim_progress(0);
+long progress_at_destroy = -1;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+/* remembers the kernel thread the caller runs on */
+void note_kernel_thread()
+{
+    int k = (int) gettid();
+    for (int i = 0; i < WORKERS; i++)
+    {
+        int seen = kernel_tids[i].load();
+        if (seen == k)
+        {
+            return;
+        }
+        if (seen == 0 && kernel_tids[i].compare_exchange_strong(seen, k))
+        {
+            return;
+        }
+    }
+}
+
+/* burns cpu in chunks, checking between chunks that its ID did not change */
+void work(long total)
+{
+    int me = uthread_get_tid();
+    volatile long x = 0;
+    for (long spent = 0; spent < total; spent += CHUNK)
+    {
+        for (long i = 0; i < CHUNK; i++)
+        {
+            x = x + 1;
+        }
+        if (uthread_get_tid() != me)
+        {
+            wrong_tid++;
+        }
+        note_kernel_thread();
+    }
+}
+
+void child()
+{
+    work(WORK / THREADS / 4);
+    finished++;
+}
+
+void worker()
+{
+    int me = uthread_get_tid();
+    // the first threads to run spawn, as a child may take a low ID before
+    // the main thread spawned all workers
+    if (spawners++ < CHILDREN && uthread_spawn(child) == -1)
+    {
+        error("spawn from a thread failed");
+    }
+    work(WORK / THREADS / 2);
+    if (me % 5 == 0 && uthread_sleep(3) == -1)
+    {
+        error("sleep failed");
+    }
+    work(WORK / THREADS / 2);
+    done[me] = true;
+    finished++;
+}
+
+void destroy(void *value)
+{
+    if (value == (void *) 1)
+    {
+        progress_at_destroy = victim_progress.load();
+        destroyed++;
+    }
+}
+
+void forever()
+{
+    uthread_setspecific(key, (void *) 1);
+    for (;;)
+    {
+        work(CHUNK);
+        victim_progress++;
+    }
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = 2000;
+    attr.workers = WORKERS;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+    if (uthread_key_create(&key, destroy) != 0)
+    {
+        error("key_create failed");
+    }
+
+    for (int i = 0; i < THREADS; i++)
+    {
+        if (uthread_spawn(worker) == -1)
+        {
+            error("spawn failed");
+        }
+    }
+    int victim = uthread_spawn(forever);
+    if (victim == -1)
+    {
+        error("spawn failed");
+    }
+
+    int next = 1;
+    while (finished.load() < THREADS + CHILDREN)
+    {
+        if (!done[next] && uthread_block(next) == 0)
+        {
+            uthread_resume(next);
+        }
+        next = next % THREADS + 1;
+        if (uthread_get_tid() != 0)
+        {
+            wrong_tid++;
+        }
+        work(CHUNK * 4);
+    }
+
+    if (uthread_terminate(victim) == -1)
+    {
+        error("terminate of a running thread failed");
+    }
+    if (destroyed.load() != 1)
+    {
+        error("the value of the terminated thread was not destroyed once");
+    }
+    work(CHUNK * 20);
+    if (victim_progress.load() != progress_at_destroy)
+    {
+        error("the terminated thread ran after its value was destroyed");
+    }
+    while (uthread_get_quantums(victim) != -1)
+    {
+        work(CHUNK);
+    }
+
+    if (wrong_tid.load() != 0)
+    {
+        error("uthread_get_tid changed inside a thread");
+    }
+    int kernel_threads = 0;
+    for (int i = 0; i < WORKERS; i++)
+    {
+        kernel_threads += kernel_tids[i].load() != 0;
+    }
+    if (kernel_threads < 2)
+    {
+        error("threads ran on a single kernel thread");
+    }
+    printf(GRN "SUCCESS - %d threads on %d kernel threads, %d quantums\n" RESET,
+           THREADS + CHILDREN, kernel_threads, uthread_get_total_quantums());
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,154 @@
+/**********************************************
+ * Test: task pool
+ * tasks run on the workers of the pool in the
+ * order they were submitted, futures pass the
+ * results to other threads, a task that waits
+ * holds only its own worker, and destroy runs
+ * the queued tasks first.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define WORKERS 4
+#define TASKS 1000
+#define WAITERS 5
+
+uthread_pool *pool;
+uthread_sem_t sem;
+int order[TASKS];
+int ran = 0;
+int waiters_ok = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void *square(void *arg)
+{
+    intptr_t n = (intptr_t) arg;
+    return (void *) (n * n);
+}
+
+void *log_order(void *arg)
+{
+    order[ran++] = (int) (intptr_t) arg;
+    return nullptr;
+}
+
+void *wait_sem(void *arg)
+{
+    uthread_sem_wait(&sem);
+    return arg;
+}
+
+/* waits on the future of a task it submits */
+void waiter()
+{
+    intptr_t me = uthread_get_tid();
+    void *ret;
+    uthread_future *future = uthread_pool_submit(pool, square, (void *) me);
+    if (uthread_future_get(future, &ret) == 0 && ret == (void *) (me * me))
+    {
+        waiters_ok++;
+    }
+}
+
+int main()
+{
+    if (uthread_init(1000) == -1)
+    {
+        error("init failed");
+    }
+    uthread_sem_init(&sem, 0);
+    if (uthread_pool_create(0) != nullptr)
+    {
+        error("a pool without workers was created");
+    }
+
+    // results
+    pool = uthread_pool_create(WORKERS);
+    static uthread_future *futures[TASKS];
+    for (intptr_t i = 0; i < TASKS; i++)
+    {
+        futures[i] = uthread_pool_submit(pool, square, (void *) i);
+    }
+    for (intptr_t i = 0; i < TASKS; i++)
+    {
+        void *ret;
+        if (uthread_future_get(futures[i], &ret) != 0 || ret != (void *) (i * i))
+        {
+            error("a future did not return the result of its task");
+        }
+    }
+    if (uthread_pool_submit(pool, nullptr, nullptr) != nullptr)
+    {
+        error("a null task was submitted");
+    }
+
+    // other threads wait on futures
+    for (int i = 0; i < WAITERS; i++)
+    {
+        uthread_spawn(waiter);
+    }
+    while (waiters_ok < WAITERS)
+    {
+        uthread_yield();
+    }
+
+    // a waiting task holds only its worker
+    uthread_future *blocked = uthread_pool_submit(pool, wait_sem, (void *) 1);
+    uthread_future *next = uthread_pool_submit(pool, square, (void *) 3);
+    void *ret;
+    if (uthread_future_get(next, &ret) != 0 || ret != (void *) 9)
+    {
+        error("a waiting task held the other workers");
+    }
+    uthread_sem_post(&sem);
+    if (uthread_future_get(blocked, &ret) != 0 || ret != (void *) 1)
+    {
+        error("a task that waited did not finish");
+    }
+    if (uthread_pool_destroy(pool) != 0)
+    {
+        error("destroy failed");
+    }
+
+    // one worker runs the tasks in order, and destroy runs the queued ones
+    pool = uthread_pool_create(1);
+    for (intptr_t i = 0; i < TASKS; i++)
+    {
+        futures[i] = uthread_pool_submit(pool, log_order, (void *) i);
+    }
+    uthread_pool_destroy(pool);
+    for (int i = 0; i < TASKS; i++)
+    {
+        if (uthread_future_get(futures[i], nullptr) != 0 || order[i] != i)
+        {
+            error("tasks did not run in order");
+        }
+    }
+
+    // closures
+    {
+        uthread_task_pool tasks(WORKERS);
+        int base = 40;
+        uthread_future *future = tasks.submit([base]() -> void * { return (void *) (intptr_t) (base + 2); });
+        if (uthread_future_get(future, &ret) != 0 || ret != (void *) 42)
+        {
+            error("a closure did not return its result");
+        }
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,199 @@
+/**********************************************
+ * Test: shared stack mode
+ * stack variables of threads at different depths
+ * survive switches and preemption, channels and
+ * join pass values between stack variables, and
+ * many idle threads fit without a stack each.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define DEEP_THREADS 50
+#define ROUNDS 20
+#define ROUND_TRIPS 1000
+#define IDLE_THREADS 50000
+
+uthread_sem_t sem;
+uthread_chan *ping;
+uthread_chan *pong;
+int finished = 0;
+int woken = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+/* fills a frame per level with values of the thread, and checks them all
+ * after switching at the bottom */
+long descend(int me, int depth)
+{
+    volatile long frame[32];
+    for (int i = 0; i < 32; i++)
+    {
+        frame[i] = me * 1000 + depth + i;
+    }
+    long sum = 0;
+    if (depth > 0)
+    {
+        sum = descend(me, depth - 1);
+    }
+    else
+    {
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            uthread_yield();
+            // spin into a preemption
+            int q = uthread_get_quantums(me);
+            while (uthread_get_quantums(me) == q)
+            {
+            }
+        }
+    }
+    for (int i = 0; i < 32; i++)
+    {
+        if (frame[i] != me * 1000 + depth + i)
+        {
+            error("a stack variable changed while the thread did not run");
+        }
+        sum += frame[i];
+    }
+    return sum;
+}
+
+void deep()
+{
+    int me = uthread_get_tid();
+    descend(me, me % 40);
+    finished++;
+}
+
+void pinger()
+{
+    long n = 0;
+    for (int i = 0; i < ROUND_TRIPS; i++)
+    {
+        uthread_chan_send(ping, &n);
+        uthread_chan_recv(pong, &n);
+    }
+    if (n != ROUND_TRIPS)
+    {
+        error("a value sent from the stack was lost");
+    }
+    uthread_chan_close(ping);
+    finished++;
+}
+
+void ponger()
+{
+    long n;
+    while (uthread_chan_recv(ping, &n) == 1)
+    {
+        n++;
+        uthread_chan_send(pong, &n);
+    }
+    finished++;
+}
+
+void *twice(void *arg)
+{
+    uthread_yield();
+    return (void *) ((intptr_t) arg * 2);
+}
+
+void *join_other(void *arg)
+{
+    int tid = uthread_spawn_arg(twice, arg);
+    void *ret = nullptr;
+    uthread_join(tid, &ret);
+    return ret;
+}
+
+void idle()
+{
+    uthread_sem_wait(&sem);
+    woken++;
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = 1000;
+    attr.shared_stack = 1;
+    attr.workers = 2;
+    if (uthread_init_attr(&attr) != -1)
+    {
+        error("a shared stack with workers was accepted");
+    }
+    attr.workers = 0;
+    attr.max_threads = IDLE_THREADS + 1;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+    uthread_sem_init(&sem, 0);
+
+    // threads at different depths, switching and preempted
+    for (int i = 0; i < DEEP_THREADS; i++)
+    {
+        uthread_spawn(deep);
+    }
+    while (finished < DEEP_THREADS)
+    {
+        uthread_yield();
+    }
+
+    // channels between stack variables
+    ping = uthread_chan_create(sizeof(long), 0);
+    pong = uthread_chan_create(sizeof(long), 0);
+    finished = 0;
+    uthread_spawn(ponger);
+    uthread_spawn(pinger);
+    while (finished < 2)
+    {
+        uthread_yield();
+    }
+
+    // a thread on the shared stack joins another
+    void *ret = nullptr;
+    int tid = uthread_spawn_arg(join_other, (void *) 21);
+    if (uthread_join(tid, &ret) != 0 || ret != (void *) 42)
+    {
+        error("join between threads on the shared stack failed");
+    }
+
+    // a terminated thread that had the stack
+    tid = uthread_spawn(idle);
+    uthread_yield();
+    uthread_terminate(tid);
+
+    // many idle threads
+    for (int i = 0; i < IDLE_THREADS; i++)
+    {
+        if (uthread_spawn(idle) == -1)
+        {
+            error("spawn of an idle thread failed");
+        }
+    }
+    uthread_yield();
+    for (int i = 0; i < IDLE_THREADS; i++)
+    {
+        uthread_sem_post(&sem);
+    }
+    while (woken < IDLE_THREADS)
+    {
+        uthread_yield();
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,72 @@
+/**********************************************
+ * Test: sleep timer wheel
+ * sleepers with short and long sleeps (crossing
+ * the first wheel level) wake up on time, while
+ * pacer threads keep the quantums going.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define NUM_PACERS 40
+#define NUM_SLEEPERS 8
+
+int durations[NUM_SLEEPERS] = {1, 2, 7, 255, 256, 257, 600, 1000};
+int elapsed[NUM_SLEEPERS];
+volatile int sleepers_done = 0;
+
+void pacer()
+{
+    while (true)
+    {
+        uthread_sleep(1);
+    }
+}
+
+void sleeper()
+{
+    int index = uthread_get_tid() - 1;
+    int start = uthread_get_total_quantums();
+    uthread_sleep(durations[index]);
+    elapsed[index] = uthread_get_total_quantums() - start;
+    sleepers_done++;
+    uthread_terminate(uthread_get_tid());
+}
+
+int main()
+{
+    printf(GRN "Test sleep wheel: " RESET);
+    fflush(stdout);
+
+    uthread_init(10);
+    for (int i = 0; i < NUM_SLEEPERS; i++)
+    {
+        uthread_spawn(sleeper);
+    }
+    for (int i = 0; i < NUM_PACERS; i++)
+    {
+        uthread_spawn(pacer);
+    }
+
+    while (sleepers_done < NUM_SLEEPERS)
+    {}
+
+    for (int i = 0; i < NUM_SLEEPERS; i++)
+    {
+        if (elapsed[i] < durations[i]
+            || elapsed[i] > durations[i] + NUM_PACERS + NUM_SLEEPERS + 2)
+        {
+            printf(RED "ERROR - thread slept %d quantums instead of %d\n" RESET,
+                   elapsed[i], durations[i]);
+            exit(1);
+        }
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+}
@@ -0,0 +1,117 @@
+/**********************************************
+ * Test: batch spawn and resume
+ * spawn_n creates all the threads or none, in
+ * order, resume_n resumes all the threads or
+ * none, and a large fan-out runs to the end.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define FAN_OUT 10000
+
+int tids[FAN_OUT];
+int order[FAN_OUT];
+int started = 0;
+int finished = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void worker()
+{
+    order[started++] = uthread_get_tid();
+    uthread_block(uthread_get_tid());
+    finished++;
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = 100000;
+    attr.max_threads = FAN_OUT + 1;
+    attr.stack_size = 16384;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+
+    if (uthread_spawn_n(nullptr, 1, tids) != -1 || uthread_spawn_n(worker, -1, tids) != -1)
+    {
+        error("spawn_n of a null entry point or a negative count was accepted");
+    }
+    if (uthread_spawn_n(worker, FAN_OUT + 1, tids) != -1)
+    {
+        error("spawn_n above the thread limit was accepted");
+    }
+    if (uthread_spawn_n(worker, 0, nullptr) != 0)
+    {
+        error("spawn_n of no threads failed");
+    }
+
+    // every ID is still free after the failed call
+    if (uthread_spawn_n(worker, FAN_OUT, tids) != 0)
+    {
+        error("spawn_n failed");
+    }
+    while (started < FAN_OUT)
+    {
+        uthread_yield();
+    }
+    for (int i = 0; i < FAN_OUT; i++)
+    {
+        if (tids[i] != i + 1 || order[i] != tids[i])
+        {
+            error("the threads did not get their ID's or did not run in order");
+        }
+    }
+
+    int bad[2] = {tids[0], FAN_OUT + 1};
+    if (uthread_resume_n(bad, 2) != -1)
+    {
+        error("resume_n of a missing thread was accepted");
+    }
+    uthread_yield();
+    if (finished != 0)
+    {
+        error("a failed resume_n resumed a thread");
+    }
+
+    if (uthread_resume_n(tids, FAN_OUT) != 0)
+    {
+        error("resume_n failed");
+    }
+    while (finished < FAN_OUT)
+    {
+        uthread_yield();
+    }
+
+    // the ID's and stacks are reused by the next fan-out
+    started = 0;
+    finished = 0;
+    if (uthread_spawn_n(worker, FAN_OUT, tids) != 0)
+    {
+        error("spawn_n after the first fan-out ended failed");
+    }
+    while (started < FAN_OUT)
+    {
+        uthread_yield();
+    }
+    uthread_resume_n(tids, FAN_OUT);
+    while (finished < FAN_OUT)
+    {
+        uthread_yield();
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
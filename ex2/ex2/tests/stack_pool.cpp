@@ -0,0 +1,109 @@
+/**********************************************
+ * Test: stack pool
+ * stacks of terminated threads are reused, the
+ * stack size given to uthread_init_attr is usable
+ * in full, and overflowing a stack hits the guard
+ * page instead of the memory below it.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define BIG_STACK (256 * 1024)
+
+volatile char *stack_seen = nullptr;
+volatile bool done = false;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void record_stack()
+{
+    char local;
+    stack_seen = &local;
+    done = true;
+    uthread_terminate(uthread_get_tid());
+}
+
+/* touches most of the stack in one frame */
+void use_big_stack()
+{
+    char buf[BIG_STACK - 16 * 1024];
+    memset(buf, 1, sizeof(buf));
+    stack_seen = buf + buf[sizeof(buf) - 1];
+    done = true;
+    uthread_terminate(uthread_get_tid());
+}
+
+int recurse(int depth)
+{
+    volatile char buf[1024];
+    buf[0] = (char) depth;
+    return recurse(depth + 1) + buf[0];
+}
+
+int overflow_status = 0;
+
+/* overflows its stack in a forked child, which must die of SIGSEGV on the
+ * guard page */
+void overflow_in_child()
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        recurse(0);
+        _exit(0);
+    }
+    waitpid(pid, &overflow_status, 0);
+    done = true;
+    uthread_terminate(uthread_get_tid());
+}
+
+void wait_done()
+{
+    while (!done)
+    {}
+    done = false;
+}
+
+int main()
+{
+    printf(GRN "Test stack pool: " RESET);
+    fflush(stdout);
+
+    uthread_attr attr = {};
+    attr.quantum_usecs = 100;
+    attr.stack_size = BIG_STACK;
+    uthread_init_attr(&attr);
+
+    uthread_spawn(record_stack);
+    wait_done();
+    volatile char *first = stack_seen;
+    uthread_spawn(record_stack);
+    wait_done();
+    if (stack_seen != first)
+        error("a freed stack was not reused");
+
+    uthread_spawn(use_big_stack);
+    wait_done();
+
+    uthread_spawn(overflow_in_child);
+    wait_done();
+    if (!WIFSIGNALED(overflow_status) || WTERMSIG(overflow_status) != SIGSEGV)
+        error("stack overflow did not fault");
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+}
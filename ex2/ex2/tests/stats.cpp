@@ -0,0 +1,157 @@
+/**********************************************
+ * Test: time statistics
+ * run time and READY wait of cpu bound threads
+ * add up to the time they ran, switches are
+ * counted and cheap, and idle time is not
+ * taken for switch cost.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define QUANTUM 10000
+#define SPIN_QUANTUMS 10
+#define YIELDS 1000
+
+uthread_sem_t sem;
+uthread_thread_stats_t spinner_stats[2];
+long spinner_lifetime[2];
+int spinners_done = 0;
+long spawned_at = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* runs for SPIN_QUANTUMS quantums of its own */
+void spin()
+{
+    int me = uthread_get_tid();
+    while (uthread_get_quantums(me) <= SPIN_QUANTUMS)
+    {
+    }
+    int i = spinners_done++;
+    uthread_thread_stats(me, &spinner_stats[i]);
+    spinner_lifetime[i] = now_ns() - spawned_at;
+    uthread_sem_post(&sem);
+}
+
+void ping()
+{
+    for (int i = 0; i < YIELDS; i++)
+    {
+        uthread_yield();
+    }
+}
+
+void nap()
+{
+    uthread_sleep(20);
+    uthread_sem_post(&sem);
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = QUANTUM;
+    attr.wall_clock = 1;
+    attr.stats = 1;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+    uthread_sem_init(&sem, 0);
+    uthread_thread_stats_t ts;
+    if (uthread_thread_stats(-1, &ts) != -1)
+    {
+        error("stats of a missing thread");
+    }
+
+    // two cpu bound threads take turns, from spawn to end each was READY,
+    // RUNNING or being switched to
+    spawned_at = now_ns();
+    uthread_spawn(spin);
+    uthread_spawn(spin);
+    uthread_sem_wait(&sem);
+    uthread_sem_wait(&sem);
+    for (int i = 0; i < 2; i++)
+    {
+        long run = spinner_stats[i].run_nsecs;
+        long ready = spinner_stats[i].ready_nsecs;
+        long total = run + ready + spinner_stats[i].switch_nsecs;
+        // wall clock time the process was descheduled for counts as run
+        // time, so a busy machine only bounds it by the lifetime
+        if (run < SPIN_QUANTUMS * QUANTUM * 1000L / 2 || run > spinner_lifetime[i])
+        {
+            error("run time is wrong");
+        }
+        if (ready < run / 4 || spinner_stats[i].switches < SPIN_QUANTUMS)
+        {
+            error("READY wait was not counted");
+        }
+        if (total < spinner_lifetime[i] * 95 / 100 || total > spinner_lifetime[i])
+        {
+            error("run time and READY wait do not add up to the lifetime");
+        }
+    }
+    uthread_stats_t stats;
+    uthread_stats(&stats);
+    long wait50 = uthread_hist_percentile(&stats.ready_wait, 50);
+    long wait100 = uthread_hist_percentile(&stats.ready_wait, 100);
+    if (wait50 > wait100 || wait100 != stats.ready_wait.max || stats.ready_wait.max < QUANTUM * 1000L / 2)
+    {
+        error("READY wait histogram is wrong");
+    }
+
+    // switches back and forth
+    long before = stats.switches;
+    uthread_spawn(ping);
+    for (int i = 0; i < YIELDS; i++)
+    {
+        uthread_yield();
+    }
+    uthread_stats(&stats);
+    if (stats.switches - before < 2 * YIELDS)
+    {
+        error("switches were not counted");
+    }
+    long cost50 = uthread_hist_percentile(&stats.switch_cost, 50);
+    long cost99 = uthread_hist_percentile(&stats.switch_cost, 99);
+    if (cost50 <= 0 || cost50 > cost99 || cost99 > stats.switch_cost.max || cost50 > 100000)
+    {
+        error("switch cost histogram is wrong");
+    }
+
+    // the process is idle while the only other thread sleeps
+    uthread_spawn(nap);
+    uthread_sem_wait(&sem);
+    uthread_stats(&stats);
+    if (stats.switch_cost.max > QUANTUM * 1000L)
+    {
+        error("idle time was counted as switch cost");
+    }
+    uthread_thread_stats(0, &ts);
+    if (ts.run_nsecs <= 0 || ts.switches < YIELDS)
+    {
+        error("main thread stats are wrong");
+    }
+
+    printf(GRN "SUCCESS - switch p50 %ld ns p99 %ld ns, READY wait p50 %ld ns\n" RESET, cost50, cost99, wait50);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,113 @@
+/**********************************************
+ * Test: stride policy
+ * cpu bound threads get quantums in proportion
+ * to their tickets, and a thread that slept does
+ * not take back the quantums it missed.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define HOGS 3
+#define RUN_QUANTUMS 300
+#define TOLERANCE 0.15
+
+uthread_sem_t sem;
+int sleeper_quantums = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void hog()
+{
+    while (true)
+    {
+    }
+}
+
+void timer()
+{
+    uthread_sleep(RUN_QUANTUMS);
+    uthread_sem_post(&sem);
+}
+
+/* sleeps long, then runs like the hogs */
+void sleeper()
+{
+    uthread_sleep(RUN_QUANTUMS);
+    int me = uthread_get_tid();
+    int start = uthread_get_quantums(me);
+    int total = uthread_get_total_quantums();
+    while (uthread_get_total_quantums() - total < 2 * HOGS)
+    {
+    }
+    sleeper_quantums = uthread_get_quantums(me) - start;
+    uthread_sem_post(&sem);
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = 2000;
+    attr.policy = UTHREAD_POLICY_STRIDE;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+    uthread_sem_init(&sem, 0);
+    if (uthread_set_tickets(0, 0) != -1 || uthread_set_tickets(0, UTHREAD_MAX_TICKETS + 1) != -1)
+    {
+        error("invalid tickets were accepted");
+    }
+
+    // tickets 100, 200 and 300
+    int hogs[HOGS];
+    for (int i = 0; i < HOGS; i++)
+    {
+        hogs[i] = uthread_spawn(hog);
+        uthread_set_tickets(hogs[i], UTHREAD_DEFAULT_TICKETS * (i + 1));
+    }
+    uthread_block(hogs[2]);
+    uthread_resume(hogs[2]);
+    uthread_spawn(timer);
+    uthread_spawn(sleeper);
+    uthread_sem_wait(&sem);
+
+    double share[HOGS];
+    for (int i = 0; i < HOGS; i++)
+    {
+        share[i] = uthread_get_share(hogs[i]);
+        printf("tickets %d share %.3f\n", UTHREAD_DEFAULT_TICKETS * (i + 1), share[i]);
+    }
+    for (int i = 1; i < HOGS; i++)
+    {
+        double ratio = share[i] / share[0];
+        if (ratio < (i + 1) * (1 - TOLERANCE) || ratio > (i + 1) * (1 + TOLERANCE))
+        {
+            error("shares were not proportional to tickets");
+        }
+    }
+    if (share[0] + share[1] + share[2] < 0.9 || share[0] + share[1] + share[2] > 1.01)
+    {
+        error("shares do not add up");
+    }
+
+    // the sleeper has 100 tickets, so about 1 quantum out of 7
+    uthread_sem_wait(&sem);
+    if (sleeper_quantums > HOGS)
+    {
+        error("a thread that slept took back the quantums it missed");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
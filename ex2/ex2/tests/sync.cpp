@@ -0,0 +1,232 @@
+/**********************************************
+ * Test: mutex, condition variable, semaphore
+ * waiters leave the ready list without using
+ * quantums, are woken in FIFO order, an
+ * unlocked mutex is handed to the first waiter,
+ * and the last thread that could post can not
+ * block or terminate itself.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define COUNTERS 5
+#define INCREMENTS 200
+#define ITEMS 50
+#define SLOTS 2
+
+uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+uthread_cond_t not_full = UTHREAD_COND_INITIALIZER;
+uthread_cond_t not_empty = UTHREAD_COND_INITIALIZER;
+uthread_sem_t sem;
+
+int order[8];
+int logged = 0;
+int counter = 0;
+int finished = 0;
+
+int buffer[SLOTS];
+int items = 0;
+long consumed_sum = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void wait_for(int n)
+{
+    while (finished < n)
+    {
+        uthread_yield();
+    }
+    finished = 0;
+}
+
+void lock_and_log()
+{
+    uthread_mutex_lock(&mutex);
+    order[logged++] = uthread_get_tid();
+    uthread_mutex_unlock(&mutex);
+    finished++;
+}
+
+void count()
+{
+    for (int i = 0; i < INCREMENTS; i++)
+    {
+        uthread_mutex_lock(&mutex);
+        int seen = counter;
+        uthread_yield();
+        counter = seen + 1;
+        uthread_mutex_unlock(&mutex);
+    }
+    finished++;
+}
+
+void produce()
+{
+    for (int i = 1; i <= ITEMS; i++)
+    {
+        uthread_mutex_lock(&mutex);
+        while (items == SLOTS)
+        {
+            uthread_cond_wait(&not_full, &mutex);
+        }
+        buffer[items++] = i;
+        uthread_cond_signal(&not_empty);
+        uthread_mutex_unlock(&mutex);
+        uthread_yield();
+    }
+    finished++;
+}
+
+void consume()
+{
+    for (int i = 0; i < ITEMS; i++)
+    {
+        uthread_mutex_lock(&mutex);
+        while (items == 0)
+        {
+            uthread_cond_wait(&not_empty, &mutex);
+        }
+        consumed_sum += buffer[--items];
+        uthread_cond_broadcast(&not_full);
+        uthread_mutex_unlock(&mutex);
+    }
+    finished++;
+}
+
+void sem_log()
+{
+    uthread_sem_wait(&sem);
+    order[logged++] = uthread_get_tid();
+    finished++;
+}
+
+/* main waits for it to post, so it can neither block nor end before that */
+void last_poster()
+{
+    int me = uthread_get_tid();
+    if (uthread_block(me) != -1 || uthread_terminate(me) != -1)
+    {
+        error("the last thread that could post stopped");
+    }
+    uthread_sem_post(&sem);
+}
+
+int main()
+{
+    // long enough that only the calls below switch threads
+    if (uthread_init(1000000) == -1)
+    {
+        error("init failed");
+    }
+
+    // handoff and waiters not running
+    uthread_mutex_lock(&mutex);
+    int a = uthread_spawn(lock_and_log);
+    int b = uthread_spawn(lock_and_log);
+    uthread_yield();
+    int a_quantums = uthread_get_quantums(a);
+    for (int i = 0; i < 5; i++)
+    {
+        uthread_yield();
+    }
+    if (uthread_get_quantums(a) != a_quantums)
+    {
+        error("a waiting thread ran");
+    }
+    uthread_mutex_unlock(&mutex);
+    if (mutex.owner != a)
+    {
+        error("unlock did not hand the mutex to the first waiter");
+    }
+    wait_for(2);
+    if (order[0] != a || order[1] != b || mutex.owner != -1)
+    {
+        error("mutex waiters were not woken in order");
+    }
+    if (uthread_mutex_unlock(&mutex) != -1)
+    {
+        error("unlock of a free mutex succeeded");
+    }
+    uthread_mutex_lock(&mutex);
+    if (uthread_mutex_lock(&mutex) != -1)
+    {
+        error("relock succeeded");
+    }
+    uthread_mutex_unlock(&mutex);
+
+    // mutual exclusion
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        uthread_spawn(count);
+    }
+    wait_for(COUNTERS);
+    if (counter != COUNTERS * INCREMENTS)
+    {
+        error("mutex did not exclude");
+    }
+
+    // condition variables
+    uthread_spawn(produce);
+    uthread_spawn(produce);
+    uthread_spawn(consume);
+    uthread_spawn(consume);
+    wait_for(4);
+    if (consumed_sum != 2L * ITEMS * (ITEMS + 1) / 2 || items != 0)
+    {
+        error("bounded buffer lost items");
+    }
+
+    // semaphore order, and a waiter that is terminated
+    uthread_sem_init(&sem, 0);
+    logged = 0;
+    int waiters[3];
+    for (int i = 0; i < 3; i++)
+    {
+        waiters[i] = uthread_spawn(sem_log);
+    }
+    int doomed = uthread_spawn(sem_log);
+    uthread_yield();
+    uthread_terminate(doomed);
+    uthread_block(waiters[1]);
+    for (int i = 0; i < 4; i++)
+    {
+        uthread_sem_post(&sem);
+    }
+    uthread_yield();
+    if (finished != 2 || order[0] != waiters[0] || order[1] != waiters[2])
+    {
+        error("semaphore did not wake in order, or woke a blocked thread");
+    }
+    uthread_resume(waiters[1]);
+    wait_for(3);
+    if (order[2] != waiters[1] || sem.value != 1)
+    {
+        error("semaphore lost a post");
+    }
+
+    if (uthread_sem_wait(&sem) != 0 || uthread_sem_wait(&sem) != -1)
+    {
+        error("main waited with no other thread to wake it");
+    }
+
+    // main waits on the semaphore, and only the poster could wake it
+    uthread_spawn(last_poster);
+    if (uthread_sem_wait(&sem) != 0 || sem.value != 0)
+    {
+        error("main woke up without a post");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
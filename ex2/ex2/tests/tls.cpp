@@ -0,0 +1,151 @@
+/**********************************************
+ * Test: thread-specific data keys
+ * every thread sees its own value across
+ * switches, and destructors run on the values
+ * of terminated threads, again for values a
+ * destructor sets.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define THREADS 10
+#define ROUNDS 50
+
+uthread_key_t key;
+uthread_key_t plain_key;
+uthread_key_t again_key;
+int destroyed[THREADS + 2];
+int destroyed_again = 0;
+int finished = 0;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void destroy(void *value)
+{
+    destroyed[(intptr_t) value]++;
+}
+
+/* sets a value once more, which the next round destroys */
+void destroy_and_set(void *value)
+{
+    destroyed_again++;
+    if (value == (void *) 1)
+    {
+        uthread_setspecific(again_key, (void *) 2);
+    }
+}
+
+void use_key()
+{
+    intptr_t me = uthread_get_tid();
+    uthread_setspecific(key, (void *) me);
+    uthread_setspecific(plain_key, (void *) (me + 100));
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        uthread_yield();
+        if (uthread_getspecific(key) != (void *) me || uthread_getspecific(plain_key) != (void *) (me + 100))
+        {
+            error("a thread saw another thread's value");
+        }
+    }
+    finished++;
+}
+
+void set_and_block()
+{
+    uthread_setspecific(key, (void *) (intptr_t) uthread_get_tid());
+    uthread_block(uthread_get_tid());
+}
+
+void set_again()
+{
+    uthread_setspecific(again_key, (void *) 1);
+}
+
+int main()
+{
+    // long enough that only the calls below switch threads
+    if (uthread_init(1000000) == -1)
+    {
+        error("init failed");
+    }
+    if (uthread_key_create(&key, destroy) != 0 || uthread_key_create(&plain_key, nullptr) != 0
+        || uthread_key_create(&again_key, destroy_and_set) != 0)
+    {
+        error("key_create failed");
+    }
+    if (uthread_setspecific(-1, nullptr) != -1 || uthread_setspecific(UTHREAD_KEYS_MAX, nullptr) != -1
+        || uthread_getspecific(UTHREAD_KEYS_MAX) != nullptr || uthread_getspecific(key) != nullptr)
+    {
+        error("an invalid key was accepted");
+    }
+
+    // values of the threads and the main thread, destroyed when a thread ends
+    uthread_setspecific(key, (void *) (THREADS + 1));
+    for (int i = 0; i < THREADS; i++)
+    {
+        uthread_spawn(use_key);
+    }
+    while (finished < THREADS)
+    {
+        uthread_yield();
+    }
+    uthread_yield();
+    for (int i = 1; i <= THREADS; i++)
+    {
+        if (destroyed[i] != 1)
+        {
+            error("a destructor did not run once on a thread's value");
+        }
+    }
+    if (uthread_getspecific(key) != (void *) (THREADS + 1) || destroyed[THREADS + 1] != 0)
+    {
+        error("the main thread's value changed");
+    }
+
+    // a thread terminated by another one
+    int blocked = uthread_spawn(set_and_block);
+    uthread_yield();
+    int before = destroyed[blocked];
+    uthread_terminate(blocked);
+    if (destroyed[blocked] != before + 1)
+    {
+        error("terminate did not destroy the value of a blocked thread");
+    }
+
+    // a destructor that sets a value
+    uthread_spawn(set_again);
+    uthread_yield();
+    uthread_yield();
+    if (destroyed_again != 2)
+    {
+        error("a value set by a destructor was not destroyed");
+    }
+
+    // keys run out
+    uthread_key_t extra;
+    int created = 3;
+    while (uthread_key_create(&extra, nullptr) == 0)
+    {
+        created++;
+    }
+    if (created != UTHREAD_KEYS_MAX)
+    {
+        error("the number of keys is wrong");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
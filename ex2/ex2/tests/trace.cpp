@@ -0,0 +1,125 @@
+/**********************************************
+ * Test: scheduler event trace
+ * the events of a thread are recorded in order,
+ * the ring keeps the newest events once it is
+ * full, and the Chrome trace dump holds a slice
+ * per run.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define RING 100
+#define RING_SIZE 128
+#define YIELDS 500
+
+uthread_trace_event_t events[2 * RING_SIZE];
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+void block_then_sleep()
+{
+    uthread_block(uthread_get_tid());
+    uthread_sleep(1);
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = 1000000;
+    attr.trace_events = RING;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+
+    // the life of a thread
+    int t = uthread_spawn(block_then_sleep);
+    uthread_yield();
+    uthread_resume(t);
+    for (int i = 0; i < 5; i++)
+    {
+        uthread_yield();
+    }
+    int n = uthread_trace_read(events, 2 * RING_SIZE);
+    int expected[] = {UTHREAD_TRACE_SPAWN, UTHREAD_TRACE_SWITCH, UTHREAD_TRACE_BLOCK, UTHREAD_TRACE_RESUME,
+                      UTHREAD_TRACE_SWITCH, UTHREAD_TRACE_SLEEP, UTHREAD_TRACE_SWITCH, UTHREAD_TRACE_TERMINATE};
+    int seen = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (i > 0 && events[i].ts_nsecs < events[i - 1].ts_nsecs)
+        {
+            error("events are out of order");
+        }
+        if (events[i].tid == t && seen < 8 && events[i].type == expected[seen])
+        {
+            seen++;
+        }
+    }
+    if (seen != 8)
+    {
+        error("the events of the thread were not recorded in order");
+    }
+
+    // a full ring keeps the newest events
+    for (int i = 0; i < YIELDS; i++)
+    {
+        uthread_yield();
+    }
+    n = uthread_trace_read(events, 2 * RING_SIZE);
+    if (n != RING_SIZE)
+    {
+        error("the ring does not hold its size in events");
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (events[i].type != UTHREAD_TRACE_SWITCH || events[i].tid != 0 || events[i].arg != 0)
+        {
+            error("the ring did not keep the newest events");
+        }
+    }
+
+    // Chrome trace
+    char path[] = "/tmp/uthreads_traceXXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1)
+    {
+        error("mkstemp failed");
+    }
+    close(fd);
+    if (uthread_trace_dump(path) != RING_SIZE)
+    {
+        error("dump failed");
+    }
+    FILE *f = fopen(path, "r");
+    static char json[1 << 16];
+    size_t len = fread(json, 1, sizeof(json) - 1, f);
+    fclose(f);
+    unlink(path);
+    json[len] = '\0';
+    int slices = 0;
+    for (char *p = strstr(json, "\"ph\":\"X\""); p != nullptr; p = strstr(p + 1, "\"ph\":\"X\""))
+    {
+        slices++;
+    }
+    if (strncmp(json, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 39) != 0
+        || strcmp(json + len - 3, "]}\n") != 0 || slices != RING_SIZE)
+    {
+        error("the dump is not a trace with a slice per run");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
@@ -0,0 +1,121 @@
+/**********************************************
+ * Test: yield and tickless mode
+ * uthread_yield passes the cpu round robin, and
+ * in tickless mode the timer only runs while
+ * another thread is ready or sleeping.
+ **********************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+#include "../uthreads.h"
+
+#define GRN "\e[32m"
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define YIELDERS 3
+#define ROUNDS 5
+
+int order[YIELDERS * ROUNDS];
+int logged = 0;
+int finished = 0;
+volatile bool woke = false;
+
+void error(const char *msg)
+{
+    printf(RED "ERROR - %s\n" RESET, msg);
+    exit(1);
+}
+
+/* @return whether the virtual timer is running */
+bool timer_running()
+{
+    struct itimerval t;
+    getitimer(ITIMER_VIRTUAL, &t);
+    return t.it_value.tv_sec != 0 || t.it_value.tv_usec != 0;
+}
+
+void yielder()
+{
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        order[logged++] = uthread_get_tid();
+        if (uthread_yield() == -1)
+        {
+            error("yield failed");
+        }
+    }
+    finished++;
+}
+
+void sleeper()
+{
+    uthread_sleep(3);
+    woke = true;
+}
+
+int main()
+{
+    uthread_attr attr = {};
+    attr.quantum_usecs = 1000000; // long enough that only yields switch
+    attr.tickless = 1;
+    if (uthread_init_attr(&attr) == -1)
+    {
+        error("init failed");
+    }
+    if (timer_running())
+    {
+        error("timer runs with only the main thread");
+    }
+
+    for (int i = 0; i < YIELDERS; i++)
+    {
+        uthread_spawn(yielder);
+    }
+    if (!timer_running())
+    {
+        error("timer stopped while threads are ready");
+    }
+    int before = uthread_get_total_quantums();
+    while (finished < YIELDERS)
+    {
+        uthread_yield();
+    }
+    for (int i = 0; i < YIELDERS * ROUNDS; i++)
+    {
+        if (order[i] != i % YIELDERS + 1)
+        {
+            error("yield is not round robin");
+        }
+    }
+    // main and the yielders each started a quantum per round
+    if (uthread_get_total_quantums() - before < (YIELDERS + 1) * ROUNDS)
+    {
+        error("yield did not start new quantums");
+    }
+    if (uthread_yield() == -1 || timer_running())
+    {
+        error("timer runs after the other threads finished");
+    }
+
+    uthread_spawn(sleeper);
+    uthread_yield();
+    if (woke || !timer_running())
+    {
+        error("timer stopped while a thread sleeps");
+    }
+    while (!woke)
+    {
+        uthread_yield();
+    }
+    uthread_yield();
+    if (timer_running())
+    {
+        error("timer runs after the sleeper finished");
+    }
+
+    printf(GRN "SUCCESS\n" RESET);
+    uthread_terminate(0);
+    return 0;
+}
@@ -4,13 +4,87 @@
 #include <iostream>
 #include <map>
 #include <setjmp.h>
-#include <deque>
-#include <algorithm>
 #include <queue>
 #include <vector>
+#include <atomic>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdio>
+#include <pthread.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <fcntl.h>
 
-#define MAX_THREAD_NUM 100 /* maximal number of threads */
-#define STACK_SIZE 4096 /* stack size per thread (in bytes) */
+#define MAX_THREAD_NUM 100 /* default maximal number of threads */
+#define STACK_SIZE 65536 /* default stack size per thread (in bytes) */
+
+#ifndef MADV_GUARD_INSTALL
+#define MADV_GUARD_INSTALL 102 /* linux 6.13, missing from older headers */
+#endif
+
+/* number of thread control blocks allocated together */
+#define THREAD_CHUNK 256
+
+/* guard pages installed by one process_madvise call */
+#define GUARD_BATCH 1024
+
+/* timer wheel geometry: WHEEL_LEVELS levels of WHEEL_SIZE slots each,
+ * level l has a resolution of WHEEL_SIZE^l quantums */
+#define WHEEL_BITS 8
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+
+/* a variable of each kernel thread. the initial-exec model makes every
+ * access a single %fs relative instruction, so a thread can not be
+ * preempted and moved to another worker in the middle of one */
+#define WORKER_LOCAL thread_local __attribute__ ((tls_model ("initial-exec")))
+
+/* attempts at the library lock before a waiting worker sleeps on it */
+#define LOCK_SPINS 100
+
+/* select cases whose waiters are kept on the stack of the waiting thread */
+#define SELECT_STACK_CASES 8
+
+/* quantums between two polls for I/O while threads are ready */
+#define IO_POLL_QUANTUMS 16
+
+/* events taken from epoll at once */
+#define IO_EVENTS 64
+
+/* quantums a thread waits in the ready queue (MLFQ policy) before it is
+ * moved up a level, so that lower levels do not starve */
+#define MLFQ_AGING_QUANTUMS 32
+
+/* rounds of destructors run on a terminated thread's specific values */
+#define KEY_DESTRUCTOR_ROUNDS 4
+
+/* per-thread arenas: chunks of ARENA_CHUNK bytes are mapped one at a time,
+ * and blocks are cut from them in ARENA_CLASSES power of two size classes
+ * from 1 << ARENA_MIN_SHIFT bytes. larger blocks are mapped on their own */
+#define ARENA_CHUNK (64 * 1024)
+#define ARENA_MIN_SHIFT 4
+#define ARENA_CLASSES 9
+#define ARENA_LARGE ARENA_CLASSES
+#define ARENA_ALIGN 16
+
+/* pass value a thread with a single ticket adds per quantum (stride policy) */
+#define STRIDE_ONE ((long) UTHREAD_MAX_TICKETS * 256)
+
+/* longest time an idle worker waits before looking for work again */
+#define IDLE_WAIT_NSECS 1000000
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid /* missing from glibc headers */
+#endif
 
 /* variable for masking */
 sigset_t masked;
@@ -18,8 +92,20 @@ sigset_t masked;
 /* the quantum value in this program */
 int quantum_val;
 
-/*current running thread*/
-int running_thread_id;
+/* the timer that ends a quantum and its signal: the process's cpu time by
+ * default, real time in wall clock mode */
+int quantum_timer = ITIMER_VIRTUAL;
+int quantum_signal = SIGVTALRM;
+
+/*current running thread of this worker, -1 while the worker is in its
+ * scheduling loop*/
+WORKER_LOCAL int running_thread_id;
+/* the specific values of the running thread, so that a lookup is a single
+ * load. Thread blocks never move, only the table of chunks grows */
+WORKER_LOCAL void **running_specific = nullptr;
+/* the arena of the running thread, also nullptr until it allocates */
+struct Arena;
+WORKER_LOCAL Arena **running_arena = nullptr;
 
 /*total quantums passed*/
 int total_quantums = 1;
@@ -51,6 +137,17 @@ address_t translate_address (address_t addr)
   return ret;
 }
 
+/* the inverse of translate_address, for an address saved by sigsetjmp */
+address_t untranslate_address (address_t addr)
+{
+  address_t ret;
+  asm volatile("ror    $0x11,%0\n"
+               "xor    %%fs:0x30,%0\n"
+  : "=g" (ret)
+  : "0" (addr));
+  return ret;
+}
+
 #else
 /* code for 32 bit Intel arch */
 
@@ -71,8 +168,67 @@ address_t translate_address(address_t addr)
   return ret;
 }
 
+/* the inverse of translate_address, for an address saved by sigsetjmp */
+address_t untranslate_address(address_t addr)
+{
+  address_t ret;
+  asm volatile("ror    $0x9,%0\n"
+               "xor    %%gs:0x18,%0\n"
+               : "=g" (ret)
+               : "0" (addr));
+  return ret;
+}
+
 #endif
 
+#ifdef UTHREADS_FAST_SWITCH
+#ifndef __x86_64__
+#error "the fast switch backend is only implemented for x86_64"
+#endif
+
+/**
+ * saves the callee saved registers and the mxcsr / x87 control words of the
+ * running thread on its own stack, stores its stack pointer in *save_sp and
+ * continues the thread whose saved stack pointer is load_sp.
+ * returns when the saved thread is switched back to. no system call is made,
+ * the signal mask is left as is.
+ */
+extern "C" void uthread_swap_context (void **save_sp, void *load_sp);
+asm (".text\n"
+     ".globl uthread_swap_context\n"
+     ".hidden uthread_swap_context\n"
+     ".type uthread_swap_context, @function\n"
+     "uthread_swap_context:\n"
+     "  pushq %rbp\n"
+     "  pushq %rbx\n"
+     "  pushq %r12\n"
+     "  pushq %r13\n"
+     "  pushq %r14\n"
+     "  pushq %r15\n"
+     "  subq $8, %rsp\n"
+     "  stmxcsr (%rsp)\n"
+     "  fnstcw 4(%rsp)\n"
+     "  movq %rsp, (%rdi)\n"
+     "  movq %rsi, %rsp\n"
+     "  ldmxcsr (%rsp)\n"
+     "  fldcw 4(%rsp)\n"
+     "  addq $8, %rsp\n"
+     "  popq %r15\n"
+     "  popq %r14\n"
+     "  popq %r13\n"
+     "  popq %r12\n"
+     "  popq %rbx\n"
+     "  popq %rbp\n"
+     "  ret\n"
+     ".size uthread_swap_context, .-uthread_swap_context\n");
+
+/* default mxcsr and x87 control word a new thread starts with */
+#define INIT_MXCSR 0x1F80
+#define INIT_FPU_CW 0x037F
+#endif
+
+struct ChanWaiter;
+
 class Thread {
  private:
   int id;
@@ -83,52 +239,572 @@ class Thread {
   /*ready and running*/
   bool ready = false;
   bool running = false;
-  int sleep = 0;
 
-  /*constructor*/
+  /* the function the thread starts from */
+  thread_entry_point entry = nullptr;
+  /* start routine and argument of a thread made by uthread_spawn_arg, and
+   * the value the routine returned */
+  void *(*start_routine) (void *) = nullptr;
+  void *arg = nullptr;
+  void *result = nullptr;
+  /* the result is kept for uthread_join until it is joined or detached */
+  bool joinable = false;
+  /* the thread waiting in uthread_join for this one, and the result a
+   * joining thread is handed */
+  uthread_wait_queue joiners = {};
+  void *join_result = nullptr;
+
+  /* lowest address of the thread's stack, nullptr for the main thread */
+  char *stack = nullptr;
+  /* shared stack mode: the used part of the thread's stack while another
+   * thread has the stack, its size, and the size of the buffer */
+  char *saved_stack = nullptr;
+  size_t saved_size = 0;
+  size_t saved_capacity = 0;
+
+#ifdef UTHREADS_FAST_SWITCH
+  /* saved stack pointer while the thread is not running, the rest of its
+   * context is saved on its own stack by uthread_swap_context */
+  void *env = nullptr;
+#else
+  /* environment of the thread */
+  sigjmp_buf env;
+#endif
+
+  /* links in the ready queue, valid while ready is set */
+  Thread *ready_next = nullptr;
+  Thread *ready_prev = nullptr;
+
+  /* priority given by the user, and the MLFQ level the thread is queued
+   * at, which moves away from the priority as the thread uses the cpu and
+   * waits. the quantum the thread last became ready in */
+  int priority = 0;
+  int level = 0;
+  int ready_since = 0;
+
+  /* stride policy: the tickets of the thread, its pass value, and its
+   * index in the heap of ready threads, -1 if it is not in it */
+  int tickets = UTHREAD_DEFAULT_TICKETS;
+  long pass = 0;
+  int heap_index = -1;
+  /* the quantum the thread was spawned in */
+  int born = 0;
+
+  /* values of the thread-specific data keys */
+  void *specific[UTHREAD_KEYS_MAX] = {};
+  /* allocator of the thread, see uthread_malloc */
+  Arena *arena = nullptr;
+
+  /* stackless task: it runs on the stack of the runner (see coro_start),
+   * which resumes its frame with co_resume until it is done. where the
+   * result of the channel operation it waits on goes */
+  bool stackless = false;
+  void *co_frame = nullptr;
+  int (*co_resume) (void *) = nullptr;
+  void (*co_destroy) (void *) = nullptr;
+  int *co_ret = nullptr;
+
+  /* time statistics, and the monotonic time (ns) the thread became ready
+   * at, 0 if it is not ready */
+  uthread_thread_stats_t stats = {};
+  long ready_at = 0;
+
+  /* adaptive quantum: the quantum of the thread in micro-seconds, 0 until
+   * its first run ended. a burst is the time (ns) the thread runs until it
+   * gives the cpu up itself, across preemptions: the current one, and the
+   * average of those that ended. the average share of its runs the thread
+   * ended itself, out of 256 */
+  int quantum = 0;
+  long burst = 0;
+  long burst_avg = 0;
+  int yield_avg = 256;
+
+  /* EDF class: period and budget in quantums, period 0 if the thread is
+   * not an EDF thread. the budget left in the current period, the quantum
+   * the current period ends in, and the periods that ended before their
+   * job was done */
+  int edf_period = 0;
+  int edf_budget = 0;
+  int edf_left = 0;
+  int edf_deadline = 0;
+  int deadline_misses = 0;
+  /* the job of the current period is done, and the thread sleeps in the
+   * timer wheel until its next period, throttled or done */
+  bool edf_done = false;
+  bool edf_waiting = false;
+  /* links in the list of EDF threads, like the timer wheel links */
+  Thread *edf_next = nullptr;
+  Thread **edf_pprev = nullptr;
+
+  /* the quantum in which a sleeping thread wakes up, 0 if not sleeping */
+  int wake_quantum = 0;
+  /* links in the timer wheel slot the thread is sleeping in. sleep_pprev
+   * points to the pointer that points to this thread */
+  Thread *sleep_next = nullptr;
+  Thread **sleep_pprev = nullptr;
+
+  /* wait queue of the synchronization object the thread waits on, nullptr
+   * if it is not waiting, and its links in that queue */
+  uthread_wait_queue *parked_on = nullptr;
+  Thread *wait_next = nullptr;
+  Thread *wait_prev = nullptr;
+  /* the wait queue the thread is parked on belongs to an fd */
+  bool waits_io = false;
+  /* the mutex a thread waiting on a condition variable takes back */
+  uthread_mutex_t *cond_mutex = nullptr;
+  /* the waiters of a thread waiting on channels, on its own stack, and
+   * the index of the one the peer completed */
+  ChanWaiter *chan_waiters = nullptr;
+  int chan_waiter_count = 0;
+  int chan_selected = -1;
+  /* shared stack mode: heap copy of the channel waiters, see chan_wait */
+  char *chan_copy = nullptr;
+
+  /* token of the thread's latest entry in a work deque (M:N mode). older
+   * entries of the thread are stale and are dropped when taken */
+  unsigned long ready_token = 0;
+  /* terminated while running on another worker, the thread is deleted as
+   * soon as it stops running */
+  bool doomed = false;
+  /* the thread that terminated it then, waiting for its key values, and
+   * where they go */
+  uthread_wait_queue terminator = {};
+  void **doomed_values = nullptr;
+
+  /*constructors, a default constructed Thread is an unused table slot*/
+  Thread () : id (-1)
+  {};
   explicit Thread (int id) : id (id)
   {};
 
   /*getters*/
   int get_quantums () const
   { return quantums; }
-  int get_sleep () const
-  { return sleep; }
+  bool is_sleeping () const
+  { return wake_quantum != 0; }
+  int get_id () const
+  { return id; }
   bool is_blocked () const
   { return blocked; }
+  bool is_parked () const
+  { return parked_on != nullptr || chan_waiters != nullptr; }
+  /* not blocked, sleeping or waiting, so the thread may be ready */
+  bool runnable () const
+  { return !blocked && wake_quantum == 0 && !is_parked () && !doomed; }
 
   /*setters*/
   void inc_quantums ()
   { quantums++; }
-  void dec_sleep ()
-  { sleep--; }
   void block ()
   { blocked = true; }
   void unblock ()
   { blocked = false; }
 };
-/* min heap of available ID's to use as names for threads*/
+/* min heap of the ID's of terminated threads, to reuse as names for new
+ * threads. ID's that were never used start at next_new_id */
 std::priority_queue<int, std::vector<int>, std::greater<int> > available_ids;
+int next_new_id = 1;
+
+/* results of joinable threads that terminated before they were joined.
+ * their ID's are not reused until then */
+std::map<int, void *> exited_results;
+
+/* maximal number of concurrent threads, including the main thread */
+int max_threads = MAX_THREAD_NUM;
+
+/* ready threads queue, an intrusive doubly linked list per level threaded
+ * through the Thread objects so a thread can leave it from any position in
+ * O(1). round robin only uses level 0, the MLFQ policy one per priority */
+struct ReadyList {
+  Thread *head = nullptr;
+  Thread *tail = nullptr;
+};
+ReadyList ready_lists[UTHREAD_PRIORITIES];
+/* ready EDF threads sorted by deadline, they run before the other levels */
+ReadyList edf_ready;
+int ready_count = 0;
+
+/* stride policy: binary min heap of the ready threads by pass value, and
+ * the pass value of the thread picked last, which threads that become
+ * ready are raised to */
+std::vector<Thread *> stride_heap;
+long stride_pass = 0;
+
+/* every EDF thread, whose periods advance once per quantum */
+Thread *edf_threads = nullptr;
+
+/* scheduling policy of the single kernel thread mode */
+int policy = UTHREAD_POLICY_RR;
+/* the switch being made ends a quantum the running thread used up */
+bool preempted = false;
+/* the quantum the MLFQ policy last aged the ready queue in */
+int last_aging = 0;
 
-/* double sided queue for ready threads */
-std::deque<int> ready_deque;
+/**
+ * table of the thread control blocks, indexed by thread ID.
+ * blocks are kept contiguously in chunks of THREAD_CHUNK, allocated when the
+ * ID's first reach them. blocks never move, so Thread pointers stay valid
+ */
+class ThreadTable {
+ private:
+  std::vector<Thread *> chunks;
+ public:
+  /* @return the thread with ID id, nullptr if there is no such thread */
+  Thread *operator[] (int id) const
+  {
+    if (id < 0 || id / THREAD_CHUNK >= (int) chunks.size ())
+      {
+        return nullptr;
+      }
+    Thread *t = &chunks[id / THREAD_CHUNK][id % THREAD_CHUNK];
+    return t->get_id () == id ? t : nullptr;
+  }
+
+  /* @return the block of a new thread with ID id */
+  Thread *create (int id)
+  {
+    while (id / THREAD_CHUNK >= (int) chunks.size ())
+      {
+        chunks.push_back (new Thread[THREAD_CHUNK]);
+      }
+    Thread *t = &chunks[id / THREAD_CHUNK][id % THREAD_CHUNK];
+    *t = Thread (id);
+    return t;
+  }
+
+  /* marks the block of thread id as unused */
+  void remove (int id)
+  {
+    chunks[id / THREAD_CHUNK][id % THREAD_CHUNK] = Thread ();
+  }
+
+  /* @return one past the highest ID that has a block */
+  int capacity () const
+  { return (int) chunks.size () * THREAD_CHUNK; }
+};
 
 /* list of current threads
  * the main thread is in index 0 */
-Thread *threads[MAX_THREAD_NUM];
+ThreadTable threads;
+
+#ifdef UTHREADS_FAST_SWITCH
+/* set while the library is in a critical section. the timer handler does
+ * not switch threads while it is set and leaves preempt_pending instead */
+WORKER_LOCAL volatile sig_atomic_t in_critical = 0;
+WORKER_LOCAL volatile sig_atomic_t preempt_pending = 0;
+#endif
+
+/* stack pool. stacks are carved out of one mmap region, each one with a
+ * guard page below it, and are reused LIFO once freed. the region is
+ * reserved for max_threads stacks, but a page is only committed once a
+ * thread touches it */
+char *stack_region = nullptr;
+size_t stack_region_size = 0;
+int stack_size = STACK_SIZE;
+int page_size = 0;
+int stacks_carved = 0;
+std::vector<char *> free_stacks;
+
+/* shared stack mode: the threads other than the main one all run on one
+ * stack, and the part a thread uses is copied out to a buffer of its own
+ * when another thread takes the stack over. the thread whose frames the
+ * stack holds, the thread being switched to, and the context that copies,
+ * which runs on a stack of its own */
+char *shared_stack = nullptr;
+Thread *stack_owner = nullptr;
+Thread *stack_next = nullptr;
+Thread copier;
+
+/* the context all stackless tasks run on, and whether the running task's
+ * own code runs on it, rather than the loop that resumes it */
+Thread coro_runner;
+bool stackless_running = false;
+/* whether the library is destroying a frame, inside a critical section */
+bool destroying_frame = false;
+
+/* hierarchical timer wheel of sleeping threads, keyed by wake up quantum.
+ * each slot is a doubly linked list threaded through the Thread objects */
+Thread *sleep_wheel[WHEEL_LEVELS][WHEEL_SIZE];
+int sleeping_threads = 0;
+
+/* tickless mode: the quantum timer is periodic, and only runs while a
+ * thread other than the running one could use the cpu */
+bool tickless = false;
+bool timer_armed = false;
+
+/* while no thread runs, a quantum passes every quantum_val micro-seconds of
+ * real time, so that sleeping threads still wake up. idle_start is the
+ * monotonic time (ns) the library went idle at, 0 while a thread runs */
+long idle_start = 0;
+long idle_counted = 0;
+
+/* time statistics (uthread_attr.stats), single worker only. run_start is
+ * the monotonic time (ns) the running thread started running at, and
+ * switch_start the time the switch being made started at */
+bool stats_on = false;
+long run_start = 0;
+long switch_start = 0;
+uthread_stats_t process_stats;
+
+/* adaptive quantum (uthread_attr.quantum_max_usecs), which needs the time
+ * statistics: the bounds of the quantums, and the share of a quantum (in
+ * percent) a switch may cost */
+bool adaptive = false;
+int quantum_min = 0;
+int quantum_max = 0;
+int overhead_target = 0;
+
+/* scheduler event trace (uthread_attr.trace_events), a ring of slots any
+ * worker writes without a lock. the seq of a slot is the index of the
+ * event it holds plus 1, or 0 while that event is being written */
+struct TraceSlot {
+  std::atomic<unsigned long> seq;
+  uthread_trace_event_t event;
+};
+TraceSlot *trace_ring = nullptr;
+unsigned long trace_mask = 0;
+std::atomic<unsigned long> trace_head (0);
+
+/**
+ * deque of ready thread tokens of a worker (M:N mode), a ring that doubles
+ * when full. it is only used under lib_lock: the owner takes from the
+ * front, so a worker runs its own threads in round robin order, and an
+ * idle worker steals the newest token from the back
+ */
+class WorkDeque {
+ private:
+  unsigned long *slots;
+  long size; // a power of 2
+  long front;
+  long back;
+
+ public:
+  WorkDeque () : slots (new unsigned long[64]), size (64), front (0), back (0)
+  {};
+
+  ~WorkDeque ()
+  {
+    delete[] slots;
+  }
+
+  /* pushes a token at the back */
+  void push (unsigned long token)
+  {
+    if (back - front == size)
+      {
+        unsigned long *bigger = new unsigned long[size * 2];
+        for (long i = front; i < back; i++)
+          {
+            bigger[i & (size * 2 - 1)] = slots[i & (size - 1)];
+          }
+        delete[] slots;
+        slots = bigger;
+        size *= 2;
+      }
+    slots[back++ & (size - 1)] = token;
+  }
+
+  /* takes the oldest token, called by the owner */
+  bool take (unsigned long *token)
+  {
+    if (front == back)
+      {
+        return false;
+      }
+    *token = slots[front++ & (size - 1)];
+    return true;
+  }
+
+  /* takes the newest token, called by another worker */
+  bool steal (unsigned long *token)
+  {
+    if (front == back)
+      {
+        return false;
+      }
+    *token = slots[--back & (size - 1)];
+    return true;
+  }
+};
+
+/* a kernel thread running user threads (M:N mode) */
+struct Worker {
+  int index = 0;
+  /* context of the worker's scheduling loop */
+  Thread loop;
+  /* ready threads pushed by this worker */
+  WorkDeque deque;
+  /* thread that stopped running for good, deleted by the loop once it is
+   * off the thread's stack */
+  int zombie = -1;
+  /* the worker went idle since it last ran a thread, and traced it */
+  bool idle_traced = false;
+  /* quantum timer of the worker, sends it quantum_signal */
+  timer_t timer;
+  /* the timer is running periodically (tickless mode) */
+  bool timer_armed = false;
+  pthread_t pthread;
+};
+
+/* number of kernel threads running user threads. with more than one, all
+ * the library state is guarded by lib_lock, and every worker schedules
+ * from its own deque */
+int num_workers = 1;
+Worker **workers = nullptr;
+WORKER_LOCAL Worker *this_worker = nullptr;
+/* 0 free, 1 held, 2 held and a worker may sleep on it */
+std::atomic<int> lib_lock (0);
+
+/* source of ready tokens, so a token is never reused by a new thread with
+ * the same ID */
+unsigned int ready_epoch = 0;
+
+/* bumped on every push, idle workers wait on it with futex */
+std::atomic<int> work_seq (0);
+/* tokens in all the deques, stale ones included. an idle worker reads it
+ * without the lock */
+std::atomic<long> queued_tokens (0);
+std::atomic<int> idle_workers (0);
+
+void scheduler (int sig);
+void switch_threads ();
+long monotonic_ns ();
+
+/**
+ * records an event in the trace ring, if the trace is on. it neither
+ * allocates nor locks, so it may run in the quantum signal handler
+ */
+void trace (int type, int tid, int arg)
+{
+  if (trace_ring == nullptr)
+    {
+      return;
+    }
+  unsigned long i = trace_head.fetch_add (1, std::memory_order_relaxed);
+  TraceSlot *slot = &trace_ring[i & trace_mask];
+  slot->seq.store (0, std::memory_order_relaxed);
+  std::atomic_thread_fence (std::memory_order_release);
+  slot->event.ts_nsecs = monotonic_ns ();
+  slot->event.type = type;
+  slot->event.worker = this_worker != nullptr ? this_worker->index : 0;
+  slot->event.tid = tid;
+  slot->event.arg = arg;
+  slot->seq.store (i + 1, std::memory_order_release);
+}
 
-/* environments of threads*/
-sigjmp_buf env[MAX_THREAD_NUM];
+/**
+ * copies up to max of the newest events of the trace ring, oldest first,
+ * skipping those being overwritten
+ * @return the number of events copied
+ */
+int trace_copy (uthread_trace_event_t *events, int max)
+{
+  unsigned long head = trace_head.load (std::memory_order_acquire);
+  unsigned long first = head > trace_mask + 1 ? head - (trace_mask + 1) : 0;
+  if (max <= 0)
+    {
+      return 0;
+    }
+  if (head - first > (unsigned long) max)
+    {
+      first = head - max;
+    }
+  int n = 0;
+  for (unsigned long i = first; i < head; i++)
+    {
+      TraceSlot *slot = &trace_ring[i & trace_mask];
+      if (slot->seq.load (std::memory_order_acquire) != i + 1)
+        {
+          continue;
+        }
+      uthread_trace_event_t event = slot->event;
+      std::atomic_thread_fence (std::memory_order_acquire);
+      if (slot->seq.load (std::memory_order_relaxed) == i + 1)
+        {
+          events[n++] = event;
+        }
+    }
+  return n;
+}
+
+/**
+ * takes the library lock (M:N mode). the lock is held across a switch
+ * between threads, and released by the thread or loop switched to. a
+ * waiter spins briefly, then sleeps on a futex: spinning with sched_yield
+ * lets a worker that never stops taking the lock starve the others
+ */
+void lock_library ()
+{
+  for (int spins = 0; spins < LOCK_SPINS; spins++)
+    {
+      int free = 0;
+      if (lib_lock.compare_exchange_weak (free, 1, std::memory_order_acquire))
+        {
+          return;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+      asm volatile ("pause");
+#endif
+    }
+  while (lib_lock.exchange (2, std::memory_order_acquire) != 0)
+    {
+      syscall (SYS_futex, (int *) &lib_lock, FUTEX_WAIT_PRIVATE, 2, nullptr,
+               nullptr, 0);
+    }
+}
+
+void unlock_library ()
+{
+  if (lib_lock.exchange (0, std::memory_order_release) == 2)
+    {
+      syscall (SYS_futex, (int *) &lib_lock, FUTEX_WAKE_PRIVATE, 1, nullptr,
+               nullptr, 0);
+    }
+}
 
-/* arrays of stacks for the existing threads */
-char *stack[MAX_THREAD_NUM];
+#ifdef UTHREADS_FAST_SWITCH
+/**
+ * enters a critical section, without a system call
+ */
+void real_block ()
+{
+  in_critical = 1;
+  std::atomic_signal_fence (std::memory_order_seq_cst);
+  if (num_workers > 1)
+    {
+      lock_library ();
+    }
+}
 
+/**
+ * leaves a critical section, and makes the switch a timer signal asked for
+ * while it was held
+ */
+void real_unblock ()
+{
+  if (num_workers > 1)
+    {
+      unlock_library ();
+    }
+  std::atomic_signal_fence (std::memory_order_seq_cst);
+  in_critical = 0;
+  std::atomic_signal_fence (std::memory_order_seq_cst);
+  if (preempt_pending)
+    {
+      scheduler (quantum_signal);
+    }
+}
+#else
 /**
  * masks real signals
  */
 void real_block ()
 {
   sigprocmask (SIG_BLOCK, &masked, nullptr);
+  if (num_workers > 1)
+    {
+      lock_library ();
+    }
 }
 
 /**
@@ -136,8 +812,13 @@ void real_block ()
  */
 void real_unblock ()
 {
+  if (num_workers > 1)
+    {
+      unlock_library ();
+    }
   sigprocmask (SIG_UNBLOCK, &masked, nullptr);
 }
+#endif
 
 /**
  * handles error
@@ -155,508 +836,4849 @@ void handle_err (const std::string &msg, Error type)
 }
 
 
-/* deletes a thread with all its mamory allocations */
-void delete_thread (int id)
+/**
+ * rounds a size up to a whole number of pages
+ */
+size_t page_round (size_t size)
 {
-  real_block ();
-  delete threads[id];
-  delete [] stack[id];
-  threads[id] = nullptr;
-  stack[id] = nullptr;
-  available_ids.push (id);
-  real_unblock ();
+  return (size + page_size - 1) / page_size * page_size;
 }
 
-void free_memory ()
+/**
+ * reserves the region the stacks are carved from. it is mapped without
+ * reserving swap, so nothing is committed until a stack page is touched
+ */
+void stack_pool_init (int size, int slots)
 {
-  for (int i = 1; i < MAX_THREAD_NUM; i++)
-  {
-    delete_thread (i);
-    if (stack[i] != nullptr)
+  page_size = (int) sysconf (_SC_PAGESIZE);
+  stack_size = (int) page_round (size);
+  stack_region_size = (size_t) slots * (page_size + stack_size);
+  void *region = mmap (nullptr, stack_region_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED)
     {
-      delete[] stack[i];
+      handle_err ("mmap of the stack region failed", SYS);
     }
-  }
+  stack_region = (char *) region;
 }
 
-
 /**
- * @brief sets a new ID to a new thread
- * @return an id integer
-*/
-int generate_id ()
+ * makes the page at addr inaccessible. a guard region installed with
+ * madvise does not split the mapping, so it works for any number of
+ * stacks. older kernels fall back to mprotect, which needs a mapping per
+ * guard page and stops once the process runs out of them
+ * @return whether the guard page was installed
+ */
+bool install_guard (char *addr)
 {
-  if (available_ids.empty ())
+  if (madvise (addr, page_size, MADV_GUARD_INSTALL) == 0)
     {
-      handle_err ("you've reached max num of threads", LIB);
-      return -1;
+      return true;
     }
-  int new_id = available_ids.top ();
-  available_ids.pop ();
-  return new_id;
-}
-
-int remove_from_ready (int tid)
-{
-  std::deque<int>::iterator itr;
-  itr = find (ready_deque.begin (), ready_deque.end (), tid);
-  if (itr != ready_deque.end ())
+  if (mprotect (addr, page_size, PROT_NONE) == 0)
     {
-      ready_deque.erase (itr);
-      threads[tid]->ready = false;
+      return true;
     }
-  else
+  if (errno != ENOMEM)
     {
-      handle_err ("not in ready", LIB);
-      return -1;
+      handle_err ("mprotect of a stack guard page failed", SYS);
     }
-  return 0;
+  handle_err ("no mapping is left for a stack guard page", LIB);
+  return false;
 }
 
+/* a freed stack the caller was still running on, so that its pages could
+ * not be released yet. the next call into the pool releases them */
+char *stack_unreleased = nullptr;
 
+/**
+ * lets the kernel take back the pages of a free stack, lazily: they stay
+ * in place until memory runs short, and a write cancels the release
+ */
+void stack_release (char *base)
+{
+  madvise (base, stack_size, MADV_FREE);
+}
 
-struct sigaction sa = {nullptr};
-struct itimerval timer;
+/* releases the pages of the stack freed last by a thread running on it */
+void stack_release_pending ()
+{
+  if (stack_unreleased != nullptr)
+    {
+      stack_release (stack_unreleased);
+      stack_unreleased = nullptr;
+    }
+}
 
-void return_to_ready (int id)
+/**
+ * @return the lowest address of a stack of stack_size bytes, the most
+ * recently freed one if there is such, a new one from the region otherwise,
+ * or nullptr if its guard page can not be installed
+ */
+char *stack_alloc ()
 {
-  ready_deque.push_back (id);
-  threads[id]->ready = true;
+  stack_release_pending ();
+  if (!free_stacks.empty ())
+    {
+      char *base = free_stacks.back ();
+      free_stacks.pop_back ();
+      return base;
+    }
+  char *guard = stack_region + (size_t) stacks_carved * (page_size + stack_size);
+  if (!install_guard (guard))
+    {
+      return nullptr;
+    }
+  stacks_carved++;
+  return guard + page_size;
 }
 
 /**
- * handles the sleeping threads
+ * makes sure the pool holds count free stacks, carving the missing ones
+ * from the region at once. their guard pages are installed with one
+ * process_madvise call per GUARD_BATCH stacks instead of one madvise call
+ * each, falling back to install_guard where the kernel cannot
+ * @return whether all count stacks are in the pool, the stacks up to the
+ * first guard page that could not be installed are kept otherwise
  */
-void handle_sleeping ()
+bool stack_reserve (int count)
 {
-  for (int i = 1; i < MAX_THREAD_NUM; i++)
+  int slots = (int) (stack_region_size / (page_size + stack_size));
+  int missing = count - (int) free_stacks.size ();
+  if (missing > slots - stacks_carved)
+    {
+      missing = slots - stacks_carved;
+    }
+  if (missing <= 0)
+    {
+      return true;
+    }
+  bool guarded = true;
+  int pidfd = (int) syscall (SYS_pidfd_open, getpid (), 0);
+  struct iovec guards[GUARD_BATCH];
+  int first = stacks_carved;
+  for (int done = 0; done < missing && guarded; done += GUARD_BATCH)
     {
-      if (threads[i] != nullptr)
+      int n = missing - done < GUARD_BATCH ? missing - done : GUARD_BATCH;
+      for (int i = 0; i < n; i++)
+        {
+          guards[i].iov_base = stack_region + (size_t) (first + done + i) * (page_size + stack_size);
+          guards[i].iov_len = page_size;
+        }
+      if (pidfd == -1
+          || syscall (SYS_process_madvise, pidfd, guards, n, MADV_GUARD_INSTALL, 0) != (long) n * page_size)
         {
-          if (threads[i]->get_sleep () != 0)
+          for (int i = 0; i < n && guarded; i++)
             {
-              threads[i]->dec_sleep ();
-              if (threads[i]->get_sleep () == 0 && !threads[i]->is_blocked ())
+              if (!install_guard ((char *) guards[i].iov_base))
                 {
-                  return_to_ready (i);
+                  missing = done + i;
+                  guarded = false;
                 }
             }
         }
     }
+  if (pidfd != -1)
+    {
+      close (pidfd);
+    }
+  // freed stacks, whose pages are committed, are still handed out first,
+  // and then the new ones from the lowest, like carving them one by one
+  std::vector<char *> carved;
+  for (int i = missing - 1; i >= 0; i--)
+    {
+      carved.push_back (stack_region + (size_t) (first + i) * (page_size + stack_size) + page_size);
+    }
+  free_stacks.insert (free_stacks.begin (), carved.begin (), carved.end ());
+  stacks_carved += missing;
+  return guarded;
 }
 
-//void make_switch ()
-//{
-//  threads[running_thread_id]->running = false;
-//  running_thread_id = ready_deque.front ();
-//  threads[running_thread_id]->running = true;
-//  threads[running_thread_id]->ready = false;
-//  ready_deque.pop_front ();
-//  threads[running_thread_id]->inc_quantums ();
-//  handle_sleeping();
-//
-//  //set time
-//  timer.it_value.tv_sec = quantum_val / 1000000;
-//  timer.it_value.tv_usec = quantum_val % 1000000;
-//  timer.it_interval.tv_sec = 0;
-//  timer.it_interval.tv_usec = 0;
-//  if (setitimer (ITIMER_VIRTUAL, &timer, nullptr))
-//    {
-//      handle_err ("err ITIMER_VIRTUAL", SYS);
-//    }
-//  total_quantums++;
-//  siglongjmp (env[running_thread_id], 1);
-//}
+/**
+ * returns a stack to the pool and releases its pages. the memory stays
+ * mapped, so a thread may free its own stack right before switching away
+ * from it, and the release of that stack waits for the next call
+ */
+void stack_free (char *base)
+{
+  stack_release_pending ();
+  char *frame = (char *) __builtin_frame_address (0);
+  if (frame >= base && frame < base + stack_size)
+    {
+      stack_unreleased = base;
+    }
+  else
+    {
+      stack_release (base);
+    }
+  free_stacks.push_back (base);
+}
 
-/* called only by the system - means a quantum has passed */
-void scheduler (int sig)
+void wheel_insert (Thread *t);
+void wheel_remove (Thread *t);
+void edf_unlink (Thread *t);
+void wait_unlink (Thread *t);
+void chan_unlink_all (Thread *t);
+Thread *unpark_first (uthread_wait_queue *q);
+void arena_release (Arena *a);
+
+/**
+ * hands the result of a terminating thread to the thread joining it, and
+ * wakes that thread. a joined thread leaves nothing behind
+ */
+void hand_result (Thread *t)
 {
-  real_block ();
+  Thread *joiner = (Thread *) t->joiners.head;
+  if (joiner == nullptr)
+    {
+      return;
+    }
+  joiner->join_result = t->result;
+  t->joinable = false;
+  unpark_first (&t->joiners);
+}
+
+/* destroys the coroutine frame of the stackless task t. the caller is
+ * inside a critical section, which uthread_co_frame_free keeps */
+void destroy_frame (Thread *t)
+{
+  destroying_frame = true;
+  t->co_destroy (t->co_frame);
+  destroying_frame = false;
+  t->co_frame = nullptr;
+}
+
+/* deletes a thread with all its mamory allocations. the stack goes back to
+ * the pool right away, a joinable thread only leaves its result and ID.
+ * the caller is inside a critical section */
+void delete_thread (int id)
+{
+  Thread *t = threads[id];
+  if (t == nullptr)
+    {
+      return;
+    }
+  hand_result (t);
+  unpark_first (&t->terminator);
+  if (t->is_sleeping ())
+    {
+      wheel_remove (t);
+    }
+  if (t->edf_period > 0)
+    {
+      edf_unlink (t);
+    }
+  if (t->parked_on != nullptr)
+    {
+      wait_unlink (t);
+    }
+  if (t->chan_waiters != nullptr)
+    {
+      chan_unlink_all (t);
+    }
+  if (t->stack != nullptr && t->stack != shared_stack)
+    {
+      stack_free (t->stack);
+    }
+  if (stack_owner == t)
+    {
+      stack_owner = nullptr;
+    }
+  delete[] t->saved_stack;
+  delete[] t->chan_copy;
+  if (t->arena != nullptr)
+    {
+      arena_release (t->arena);
+    }
+  // the frame of a stackless task that is still running is in use
+  if (t->co_frame != nullptr && !t->running)
+    {
+      destroy_frame (t);
+    }
+  bool keep_id = t->joinable;
+  if (keep_id)
+    {
+      exited_results[id] = t->result;
+    }
+  threads.remove (id);
+  if (!keep_id)
+    {
+      available_ids.push (id);
+    }
+}
+
+void free_memory ()
+{
+  for (int i = 1; i < threads.capacity (); i++)
+  {
+    delete_thread (i);
+  }
+  if (threads[0] != nullptr && threads[0]->arena != nullptr)
+    {
+      arena_release (threads[0]->arena);
+      threads[0]->arena = nullptr;
+    }
+  // a thread that terminates the process is still running on the region,
+  // and so may the other workers
+  if (running_thread_id == 0 && num_workers == 1 && stack_region != nullptr)
+    {
+      munmap (stack_region, stack_region_size);
+      stack_region = nullptr;
+    }
+}
+
+
+/* appends t to the ready list l */
+void list_append (ReadyList *l, Thread *t)
+{
+  t->ready_next = nullptr;
+  t->ready_prev = l->tail;
+  if (l->tail != nullptr)
+    {
+      l->tail->ready_next = t;
+    }
+  else
+    {
+      l->head = t;
+    }
+  l->tail = t;
+}
+
+/* unlinks t from the ready list l it is in */
+void list_unlink (ReadyList *l, Thread *t)
+{
+  if (t->ready_prev != nullptr)
+    {
+      t->ready_prev->ready_next = t->ready_next;
+    }
+  else
+    {
+      l->head = t->ready_next;
+    }
+  if (t->ready_next != nullptr)
+    {
+      t->ready_next->ready_prev = t->ready_prev;
+    }
+  else
+    {
+      l->tail = t->ready_prev;
+    }
+  t->ready_next = nullptr;
+  t->ready_prev = nullptr;
+}
+
+/* inserts t in the ready list l, which is sorted by deadline, after the
+ * threads with the same deadline */
+void list_insert_by_deadline (ReadyList *l, Thread *t)
+{
+  Thread *prev = l->tail;
+  while (prev != nullptr && prev->edf_deadline > t->edf_deadline)
+    {
+      prev = prev->ready_prev;
+    }
+  t->ready_prev = prev;
+  t->ready_next = prev != nullptr ? prev->ready_next : l->head;
+  if (t->ready_next != nullptr)
+    {
+      t->ready_next->ready_prev = t;
+    }
+  else
+    {
+      l->tail = t;
+    }
+  if (prev != nullptr)
+    {
+      prev->ready_next = t;
+    }
+  else
+    {
+      l->head = t;
+    }
+}
 
-  int has_returned = 0;
-  has_returned = sigsetjmp(env[running_thread_id], 1);
+/* swaps the entries i and j of the stride heap */
+void heap_swap (int i, int j)
+{
+  std::swap (stride_heap[i], stride_heap[j]);
+  stride_heap[i]->heap_index = i;
+  stride_heap[j]->heap_index = j;
+}
 
-  if (!has_returned)
+/* moves entry i of the stride heap up or down to its place */
+void heap_fix (int i)
+{
+  while (i > 0 && stride_heap[i]->pass < stride_heap[(i - 1) / 2]->pass)
+    {
+      heap_swap (i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+  int n = (int) stride_heap.size ();
+  while (true)
     {
-      if (!threads[running_thread_id]->is_blocked ()
-          && threads[running_thread_id]->sleep <= 0)
+      int least = i;
+      for (int child = 2 * i + 1; child <= 2 * i + 2 && child < n; child++)
+        {
+          if (stride_heap[child]->pass < stride_heap[least]->pass)
+            {
+              least = child;
+            }
+        }
+      if (least == i)
         {
-          ready_deque.push_back (running_thread_id);
-          threads[running_thread_id]->ready = true;
+          return;
         }
-      threads[running_thread_id]->running = false;
-      running_thread_id = ready_deque.front ();
-      threads[running_thread_id]->running = true;
-      threads[running_thread_id]->ready = false;
-      ready_deque.pop_front ();
-      total_quantums++;
-      threads[running_thread_id]->inc_quantums ();
-      handle_sleeping();
+      heap_swap (i, least);
+      i = least;
+    }
+}
+
+/* adds thread t to the stride heap */
+void heap_push (Thread *t)
+{
+  t->heap_index = (int) stride_heap.size ();
+  stride_heap.push_back (t);
+  heap_fix (t->heap_index);
+}
+
+/* removes thread t from any position of the stride heap */
+void heap_erase (Thread *t)
+{
+  int i = t->heap_index;
+  Thread *last = stride_heap.back ();
+  stride_heap.pop_back ();
+  if (last != t)
+    {
+      stride_heap[i] = last;
+      last->heap_index = i;
+      heap_fix (i);
+    }
+  t->heap_index = -1;
+}
+
+/* the ready list thread t is queued in while it is ready */
+ReadyList *ready_list (Thread *t)
+{
+  return t->edf_period > 0 ? &edf_ready : &ready_lists[t->level];
+}
+
+/* destructors of the thread-specific data keys, which are created in order */
+void (*key_destructors[UTHREAD_KEYS_MAX]) (void *);
+int keys_created = 0;
+
+/**
+ * takes the values of thread t that have a key destructor into values,
+ * which has a slot per key, and leaves nullptr in their place. the thread
+ * is not running, or is the caller. the caller is inside a critical section
+ * @return whether any value was taken
+ */
+bool take_specific (Thread *t, void **values)
+{
+  bool found = false;
+  for (int k = 0; k < UTHREAD_KEYS_MAX; k++)
+    {
+      values[k] = nullptr;
+      if (k < keys_created && key_destructors[k] != nullptr && t->specific[k] != nullptr)
+        {
+          values[k] = t->specific[k];
+          t->specific[k] = nullptr;
+          found = true;
+        }
+    }
+  return found;
+}
 
-      timer.it_value.tv_sec = quantum_val / 1000000;
-      timer.it_value.tv_usec = quantum_val % 1000000;
-      timer.it_interval.tv_sec = 0;
-      timer.it_interval.tv_usec = 0;
+/**
+ * runs the key destructors on values taken with take_specific. they are
+ * user code, so they run outside the critical section
+ */
+void run_destructors (void **values)
+{
+  for (int k = 0; k < UTHREAD_KEYS_MAX; k++)
+    {
+      if (values[k] != nullptr)
+        {
+          key_destructors[k] (values[k]);
+        }
+    }
+}
 
-      if (setitimer (ITIMER_VIRTUAL, &timer, nullptr))
+/**
+ * runs the key destructors on the specific values of thread tid, which is
+ * the caller. values a destructor sets are destroyed in the next round
+ */
+void destroy_specific (int tid)
+{
+  for (int round = 0; round < KEY_DESTRUCTOR_ROUNDS; round++)
+    {
+      void *values[UTHREAD_KEYS_MAX];
+      real_block ();
+      Thread *t = threads[tid];
+      bool found = t != nullptr && take_specific (t, values);
+      real_unblock ();
+      if (!found)
         {
-          handle_err ("err ITIMER_VIRTUAL", SYS);
+          return;
         }
-      siglongjmp (env[running_thread_id], 1);
+      run_destructors (values);
+    }
+}
 
+/**
+ * @brief sets a new ID to a new thread
+ * @return an id integer
+*/
+int generate_id ()
+{
+  if (!available_ids.empty ())
+    {
+      int new_id = available_ids.top ();
+      available_ids.pop ();
+      return new_id;
     }
-  real_unblock ();
+  if (next_new_id >= max_threads)
+    {
+      handle_err ("you've reached max num of threads", LIB);
+      return -1;
+    }
+  return next_new_id++;
 }
 
-// in case a thread terminates itself
-void terminated_switch ()
+int remove_from_ready (int tid)
 {
-  int terminated_thread = running_thread_id;
+  Thread *t = threads[tid];
+  if (!t->ready)
+    {
+      handle_err ("not in ready", LIB);
+      return -1;
+    }
+  if (num_workers > 1)
+    {
+      // its deque entry is left behind, and dropped once it is taken
+      t->ready = false;
+      return 0;
+    }
+  if (t->heap_index >= 0)
+    {
+      heap_erase (t);
+    }
+  else
+    {
+      list_unlink (ready_list (t), t);
+    }
+  ready_count--;
+  t->ready = false;
+  return 0;
+}
 
-  threads[running_thread_id]->running = false;
-  running_thread_id = ready_deque.front ();
-  threads[running_thread_id]->running = true;
-  threads[running_thread_id]->ready = false;
-  ready_deque.pop_front ();
-  total_quantums++;
-  threads[running_thread_id]->inc_quantums ();
-  handle_sleeping();
 
-  timer.it_value.tv_sec = quantum_val / 1000000;
-  timer.it_value.tv_usec = quantum_val % 1000000;
-  timer.it_interval.tv_sec = 0;
-  timer.it_interval.tv_usec = 0;
 
-  delete_thread (terminated_thread);
+struct sigaction sa = {nullptr};
+struct itimerval timer;
 
-  if (setitimer (ITIMER_VIRTUAL, &timer, nullptr))
-  {
-    handle_err ("err ITIMER_VIRTUAL", SYS);
-  }
-  siglongjmp (env[running_thread_id], 1);
+/**
+ * tickless mode: starts the periodic timer once another thread is ready or
+ * sleeping, and stops it when the running thread is the only one left
+ */
+void update_tick ()
+{
+  bool needed = ready_count > 0 || sleeping_threads > 0;
+  if (needed == timer_armed)
+    {
+      return;
+    }
+  timer.it_value.tv_sec = needed ? quantum_val / 1000000 : 0;
+  timer.it_value.tv_usec = needed ? quantum_val % 1000000 : 0;
+  timer.it_interval = timer.it_value;
+  if (setitimer (quantum_timer, &timer, nullptr))
+    {
+      handle_err ("err setitimer", SYS);
+    }
+  timer_armed = needed;
+}
 
+/**
+ * wakes an idle worker after work was pushed (M:N mode)
+ */
+void notify_idle ()
+{
+  work_seq.fetch_add (1);
+  if (idle_workers.load () > 0)
+    {
+      syscall (SYS_futex, (int *) &work_seq, FUTEX_WAKE_PRIVATE, 1,
+               nullptr, nullptr, 0);
+    }
+}
 
-//  make_switch ();
+/* adds a thread to the end of the ready queue */
+void return_to_ready (int id)
+{
+  Thread *t = threads[id];
+  if (num_workers > 1)
+    {
+      t->ready = true;
+      t->ready_token = ((unsigned long) ++ready_epoch << 32) | (unsigned int) id;
+      this_worker->deque.push (t->ready_token);
+      queued_tokens.fetch_add (1, std::memory_order_relaxed);
+      notify_idle ();
+      return;
+    }
+  if (t->edf_period > 0)
+    {
+      list_insert_by_deadline (&edf_ready, t);
+    }
+  else if (policy == UTHREAD_POLICY_STRIDE)
+    {
+      // no credit for the quantums it spent away
+      t->pass = t->pass > stride_pass ? t->pass : stride_pass;
+      heap_push (t);
+    }
+  else
+    {
+      list_append (&ready_lists[t->level], t);
+    }
+  if (stats_on)
+    {
+      t->ready_at = monotonic_ns ();
+    }
+  ready_count++;
+  t->ready_since = total_quantums;
+  t->ready = true;
+  if (tickless && !timer_armed)
+    {
+      update_tick ();
+    }
+}
 
+/* removes the ready EDF thread with the nearest deadline, or else the
+ * thread with the lowest pass value (stride policy) or the thread at the
+ * front of the highest non empty level of the ready queue, and returns
+ * its id, -1 if no thread is ready */
+int pop_ready ()
+{
+  if (ready_count == 0)
+    {
+      return -1;
+    }
+  if (edf_ready.head != nullptr)
+    {
+      int id = edf_ready.head->get_id ();
+      remove_from_ready (id);
+      return id;
+    }
+  if (policy == UTHREAD_POLICY_STRIDE)
+    {
+      Thread *t = stride_heap[0];
+      stride_pass = t->pass;
+      heap_erase (t);
+      ready_count--;
+      t->ready = false;
+      return t->get_id ();
+    }
+  int level = 0;
+  while (ready_lists[level].head == nullptr)
+    {
+      level++;
+    }
+  int id = ready_lists[level].head->get_id ();
+  remove_from_ready (id);
+  return id;
 }
 
-// in case a thread blocked itself
-//void sleep_or_blocked_switch ()
-//{
-//  if (sigsetjmp(env[running_thread_id], 1) == 1)
-//    {
-//      real_unblock ();
-//      return;
-//    }
-//  make_switch ();
-//}
+/**
+ * MLFQ policy: moves the running thread t a level down if it used up its
+ * quantum, or a level back up towards its priority if it stopped early
+ */
+void mlfq_account (Thread *t)
+{
+  if (preempted)
+    {
+      t->level += t->level < UTHREAD_PRIORITIES - 1;
+    }
+  else if (t->level > t->priority)
+    {
+      t->level--;
+    }
+}
 
 /**
- * @brief initializes the thread library.
- *
- * You may assume that this function is called before any other thread library function, and that it is called
- * exactly once.
- * The input to the function is the length of a quantum in micro-seconds.
- * It is an error to call this function with non-positive quantum_usecs.
+ * MLFQ policy: moves the threads that waited MLFQ_AGING_QUANTUMS in the
+ * ready queue a level up, above their priority if needed, so that threads
+ * of higher levels can not starve them
+ */
+void mlfq_age ()
+{
+  for (int level = 1; level < UTHREAD_PRIORITIES; level++)
+    {
+      Thread *t = ready_lists[level].head;
+      while (t != nullptr)
+        {
+          Thread *next = t->ready_next;
+          if (total_quantums - t->ready_since >= MLFQ_AGING_QUANTUMS)
+            {
+              list_unlink (&ready_lists[level], t);
+              t->level = level - 1;
+              list_append (&ready_lists[level - 1], t);
+              t->ready_since = total_quantums;
+            }
+          t = next;
+        }
+    }
+}
+
+/**
+ * moves thread t to the level of its priority, requeuing it if it is ready
+ */
+void mlfq_reset (Thread *t)
+{
+  if (t->ready && num_workers == 1 && t->edf_period == 0)
+    {
+      list_unlink (&ready_lists[t->level], t);
+      list_append (&ready_lists[t->priority], t);
+    }
+  t->level = t->priority;
+}
+
+/**
+ * EDF class: puts thread t in the timer wheel until its next period, so
+ * that the idle process knows when to wake up. the thread leaves it in
+ * edf_release
+ */
+void edf_wait (Thread *t)
+{
+  t->edf_waiting = true;
+  t->wake_quantum = t->edf_deadline;
+  wheel_insert (t);
+  sleeping_threads++;
+}
+
+/**
+ * EDF class: uses a quantum of the budget of the running thread t, and
+ * throttles it if it used up its budget before its job is done
+ */
+void edf_account (Thread *t)
+{
+  t->edf_left--;
+  if (t->edf_left <= 0 && !t->edf_done && !t->is_sleeping ())
+    {
+      edf_wait (t);
+    }
+}
+
+/**
+ * EDF class: begins the next period of the threads whose deadline is the
+ * current quantum, counting a miss for each period that ended before its
+ * job was done, and wakes up the threads that waited for it.
+ * called once per quantum, after total_quantums was advanced
+ */
+void edf_release ()
+{
+  for (Thread *t = edf_threads; t != nullptr; t = t->edf_next)
+    {
+      if (t->edf_deadline > total_quantums)
+        {
+          continue;
+        }
+      while (t->edf_deadline <= total_quantums)
+        {
+          t->deadline_misses += !t->edf_done;
+          t->edf_done = false;
+          t->edf_deadline += t->edf_period;
+        }
+      t->edf_left = t->edf_budget;
+      if (t->edf_waiting)
+        {
+          t->edf_waiting = false;
+          if (t->is_sleeping ())
+            {
+              wheel_remove (t);
+            }
+        }
+      if (t->ready)
+        {
+          // its deadline moved
+          list_unlink (&edf_ready, t);
+          list_insert_by_deadline (&edf_ready, t);
+        }
+      else if (t->runnable () && !t->running)
+        {
+          return_to_ready (t->get_id ());
+        }
+    }
+}
+
+/* removes thread t from the list of EDF threads */
+void edf_unlink (Thread *t)
+{
+  *t->edf_pprev = t->edf_next;
+  if (t->edf_next != nullptr)
+    {
+      t->edf_next->edf_pprev = t->edf_pprev;
+    }
+  t->edf_next = nullptr;
+  t->edf_pprev = nullptr;
+}
+
+/**
+ * takes the next ready thread for worker w (M:N mode): the oldest entry of
+ * its own deque, or else the newest one stolen from another worker. stale
+ * entries, of threads that were blocked or terminated since, are dropped
+ * on the way
+ * @return the id of the thread, -1 if no thread is ready
+ */
+int take_ready (Worker *w)
+{
+  for (int i = 0; i < num_workers; i++)
+    {
+      WorkDeque &victim = workers[(w->index + i) % num_workers]->deque;
+      unsigned long token;
+      while (i == 0 ? victim.take (&token) : victim.steal (&token))
+        {
+          queued_tokens.fetch_sub (1, std::memory_order_relaxed);
+          int id = (int) (token & 0xffffffffUL);
+          Thread *t = threads[id];
+          if (t != nullptr && t->ready && t->ready_token == token)
+            {
+              t->ready = false;
+              return id;
+            }
+        }
+    }
+  return -1;
+}
+
+/* @return whether any deque may be non empty (M:N mode) */
+bool work_available ()
+{
+  return queued_tokens.load (std::memory_order_relaxed) > 0;
+}
+
+/**
+ * puts a sleeping thread in the wheel slot matching its wake up quantum.
+ * a thread that wakes up within WHEEL_SIZE^(l+1) quantums goes to level l
+ */
+void wheel_insert (Thread *t)
+{
+  unsigned int delta = t->wake_quantum - total_quantums;
+  int level = 0;
+  while (level < WHEEL_LEVELS - 1 && delta >= (1u << (WHEEL_BITS * (level + 1))))
+    {
+      level++;
+    }
+  Thread **slot = &sleep_wheel[level][(t->wake_quantum >> (WHEEL_BITS * level))
+                                      & WHEEL_MASK];
+  t->sleep_next = *slot;
+  t->sleep_pprev = slot;
+  if (*slot != nullptr)
+    {
+      (*slot)->sleep_pprev = &t->sleep_next;
+    }
+  *slot = t;
+}
+
+/**
+ * unlinks a sleeping thread from the wheel slot it is in
+ */
+void wheel_remove (Thread *t)
+{
+  *t->sleep_pprev = t->sleep_next;
+  if (t->sleep_next != nullptr)
+    {
+      t->sleep_next->sleep_pprev = t->sleep_pprev;
+    }
+  t->sleep_next = nullptr;
+  t->sleep_pprev = nullptr;
+  t->wake_quantum = 0;
+  sleeping_threads--;
+}
+
+/**
+ * moves the threads of a higher level slot down to the levels below it,
+ * now that they wake up within that level's range
+ */
+void wheel_cascade (int level)
+{
+  int idx = (total_quantums >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  Thread *t = sleep_wheel[level][idx];
+  sleep_wheel[level][idx] = nullptr;
+  while (t != nullptr)
+    {
+      Thread *next = t->sleep_next;
+      wheel_insert (t);
+      t = next;
+    }
+}
+
+/**
+ * handles the sleeping threads.
+ * called once per quantum, after total_quantums was advanced. only the
+ * threads whose sleep expires in this quantum are touched
+ */
+void handle_sleeping ()
+{
+  if (edf_threads != nullptr)
+    {
+      edf_release ();
+    }
+
+  int idx = total_quantums & WHEEL_MASK;
+  for (int level = 1; level < WHEEL_LEVELS && idx == 0; level++)
+    {
+      wheel_cascade (level);
+      idx = (total_quantums >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    }
+
+  Thread *t = sleep_wheel[0][total_quantums & WHEEL_MASK];
+  sleep_wheel[0][total_quantums & WHEEL_MASK] = nullptr;
+  while (t != nullptr)
+    {
+      Thread *next = t->sleep_next;
+      t->sleep_next = nullptr;
+      t->sleep_pprev = nullptr;
+      t->wake_quantum = 0;
+      sleeping_threads--;
+      if (t->runnable ())
+        {
+          return_to_ready (t->get_id ());
+        }
+      t = next;
+    }
+}
+
+//void make_switch ()
+//{
+//  threads[running_thread_id]->running = false;
+//  running_thread_id = ready_deque.front ();
+//  threads[running_thread_id]->running = true;
+//  threads[running_thread_id]->ready = false;
+//  ready_deque.pop_front ();
+//  threads[running_thread_id]->inc_quantums ();
+//  handle_sleeping();
+//
+//  //set time
+//  timer.it_value.tv_sec = quantum_val / 1000000;
+//  timer.it_value.tv_usec = quantum_val % 1000000;
+//  timer.it_interval.tv_sec = 0;
+//  timer.it_interval.tv_usec = 0;
+//  if (setitimer (ITIMER_VIRTUAL, &timer, nullptr))
+//    {
+//      handle_err ("err ITIMER_VIRTUAL", SYS);
+//    }
+//  total_quantums++;
+//  siglongjmp (env[running_thread_id], 1);
+//}
+
+/* threads waiting until an fd can be read or written */
+struct IoFd {
+  uthread_wait_queue readers;
+  uthread_wait_queue writers;
+  /* the fd is in the epoll set */
+  bool registered = false;
+};
+
+/* epoll instance of the scheduler, created on the first wait for I/O. an
+ * fd stays registered for both directions, edge triggered, until
+ * uthread_close, so a wait only needs a system call if the fd is new */
+int epoll_fd = -1;
+std::vector<IoFd *> io_fds;
+int io_waiters = 0;
+
+/**
+ * appends t to the wait queue q
+ */
+void wait_push (uthread_wait_queue *q, Thread *t)
+{
+  Thread *tail = (Thread *) q->tail;
+  t->wait_next = nullptr;
+  t->wait_prev = tail;
+  if (tail != nullptr)
+    {
+      tail->wait_next = t;
+    }
+  else
+    {
+      q->head = t;
+    }
+  q->tail = t;
+  t->parked_on = q;
+}
+
+/**
+ * unlinks a waiting thread from the wait queue it is in
+ */
+void wait_unlink (Thread *t)
+{
+  uthread_wait_queue *q = t->parked_on;
+  if (t->wait_prev != nullptr)
+    {
+      t->wait_prev->wait_next = t->wait_next;
+    }
+  else
+    {
+      q->head = t->wait_next;
+    }
+  if (t->wait_next != nullptr)
+    {
+      t->wait_next->wait_prev = t->wait_prev;
+    }
+  else
+    {
+      q->tail = t->wait_prev;
+    }
+  t->wait_next = nullptr;
+  t->wait_prev = nullptr;
+  t->parked_on = nullptr;
+  if (t->waits_io)
+    {
+      t->waits_io = false;
+      io_waiters--;
+    }
+}
+
+/**
+ * @return whether the running thread is the last one that can run, that is
+ * no other thread is ready, sleeps or waits for I/O. M:N mode can not
+ * tell, and assumes it is not
+ */
+bool last_runnable ()
+{
+  return num_workers == 1 && ready_count == 0 && io_waiters == 0
+         && sleeping_threads == 0;
+}
+
+/**
+ * @return whether the running thread may wait, that is some other thread
+ * is ready or waits for I/O, and may wake it
+ */
+bool may_park ()
+{
+  if (last_runnable ())
+    {
+      handle_err ("deadlock, no other thread is ready", LIB);
+      return false;
+    }
+  return true;
+}
+
+/**
+ * makes the running thread wait on q and switches to the next thread.
+ * returns once the thread was woken and runs again
+ * @return 0, -1 if no other thread is ready to wake it
+ */
+int park (uthread_wait_queue *q)
+{
+  if (!may_park ())
+    {
+      return -1;
+    }
+  wait_push (q, threads[running_thread_id]);
+  switch_threads ();
+  return 0;
+}
+
+/**
+ * wakes the first thread waiting in q
+ * @return the woken thread, nullptr if no thread waits in q
+ */
+Thread *unpark_first (uthread_wait_queue *q)
+{
+  Thread *t = (Thread *) q->head;
+  if (t == nullptr)
+    {
+      return nullptr;
+    }
+  wait_unlink (t);
+  if (t->runnable ())
+    {
+      return_to_ready (t->get_id ());
+    }
+  return t;
+}
+
+/**
+ * moves a thread woken from a condition variable to the mutex it waited
+ * with. the thread is only ready once it holds the mutex
+ */
+void cond_requeue (Thread *t)
+{
+  uthread_mutex_t *mutex = t->cond_mutex;
+  t->cond_mutex = nullptr;
+  if (mutex->owner != -1)
+    {
+      wait_push (&mutex->waiters, t);
+      return;
+    }
+  mutex->owner = t->get_id ();
+  if (t->runnable ())
+    {
+      return_to_ready (t->get_id ());
+    }
+}
+
+/* a thread waiting on a channel, one for each case of a select */
+struct ChanWaiter {
+  Thread *thread;
+  uthread_chan *chan;
+  bool send;
+  /* the element to send, or where to store the received one */
+  void *elem;
+  /* index of the case in the select */
+  int index;
+  /* set by the peer, false if the channel was closed */
+  bool ok;
+  ChanWaiter *next;
+  ChanWaiter *prev;
+};
+
+/* FIFO of the waiters of one direction of a channel */
+struct ChanQueue {
+  ChanWaiter *head;
+  ChanWaiter *tail;
+};
+
+struct uthread_chan {
+  int elem_size;
+  int capacity;
+  bool closed;
+  /* ring of buf_slots elements, count of them from head are buffered */
+  char *buf;
+  int buf_slots;
+  int head;
+  int count;
+  ChanQueue sendq;
+  ChanQueue recvq;
+};
+
+/* case of the next select to look at first */
+unsigned int select_rotor = 0;
+
+void chan_enqueue (ChanQueue *q, ChanWaiter *w)
+{
+  w->next = nullptr;
+  w->prev = q->tail;
+  if (q->tail != nullptr)
+    {
+      q->tail->next = w;
+    }
+  else
+    {
+      q->head = w;
+    }
+  q->tail = w;
+}
+
+void chan_unlink (ChanQueue *q, ChanWaiter *w)
+{
+  if (w->prev != nullptr)
+    {
+      w->prev->next = w->next;
+    }
+  else
+    {
+      q->head = w->next;
+    }
+  if (w->next != nullptr)
+    {
+      w->next->prev = w->prev;
+    }
+  else
+    {
+      q->tail = w->prev;
+    }
+}
+
+/**
+ * unlinks all the channel waiters of t, it no longer waits on channels
+ */
+void chan_unlink_all (Thread *t)
+{
+  for (int i = 0; i < t->chan_waiter_count; i++)
+    {
+      ChanWaiter *w = &t->chan_waiters[i];
+      chan_unlink (w->send ? &w->chan->sendq : &w->chan->recvq, w);
+    }
+  t->chan_waiters = nullptr;
+  t->chan_waiter_count = 0;
+}
+
+/**
+ * ends the wait of the thread of w, whose operation the peer performed.
+ * its other waiters are dropped, and it becomes ready
+ */
+void chan_complete (ChanWaiter *w, bool ok)
+{
+  Thread *t = w->thread;
+  w->ok = ok;
+  t->chan_selected = w->index;
+  chan_unlink_all (t);
+  if (t->runnable ())
+    {
+      return_to_ready (t->get_id ());
+    }
+}
+
+/* @return the address of the i-th buffered element */
+char *chan_slot (uthread_chan *chan, int i)
+{
+  return chan->buf + (size_t) ((chan->head + i) % chan->buf_slots) * chan->elem_size;
+}
+
+/**
+ * appends a copy of elem to the buffer, growing the buffer of an unbounded
+ * channel if it is full
+ */
+void chan_buffer_push (uthread_chan *chan, const void *elem)
+{
+  if (chan->count == chan->buf_slots)
+    {
+      int slots = chan->buf_slots * 2;
+      char *buf = new char[(size_t) slots * chan->elem_size];
+      for (int i = 0; i < chan->count; i++)
+        {
+          memcpy (buf + (size_t) i * chan->elem_size, chan_slot (chan, i),
+                  chan->elem_size);
+        }
+      delete[] chan->buf;
+      chan->buf = buf;
+      chan->buf_slots = slots;
+      chan->head = 0;
+    }
+  memcpy (chan_slot (chan, chan->count), elem, chan->elem_size);
+  chan->count++;
+}
+
+void chan_buffer_pop (uthread_chan *chan, void *elem)
+{
+  memcpy (elem, chan_slot (chan, 0), chan->elem_size);
+  chan->head = (chan->head + 1) % chan->buf_slots;
+  chan->count--;
+}
+
+/* @return whether a send to chan would not wait */
+bool chan_can_send (uthread_chan *chan)
+{
+  return chan->recvq.head != nullptr || chan->capacity == UTHREAD_CHAN_UNBOUNDED
+         || chan->count < chan->capacity;
+}
+
+/* @return whether a receive from chan would not wait */
+bool chan_can_recv (uthread_chan *chan)
+{
+  return chan->count > 0 || chan->sendq.head != nullptr || chan->closed;
+}
+
+/**
+ * sends elem to an open channel that chan_can_send. a waiting receiver
+ * gets it directly
+ */
+void chan_send_now (uthread_chan *chan, const void *elem)
+{
+  ChanWaiter *w = chan->recvq.head;
+  if (w == nullptr)
+    {
+      chan_buffer_push (chan, elem);
+      return;
+    }
+  memcpy (w->elem, elem, chan->elem_size);
+  chan_complete (w, true);
+}
+
+/**
+ * receives into elem from a channel that chan_can_recv. the first waiting
+ * sender's element takes the freed buffer slot, or is taken directly
+ * @return 1 if an element was received, 0 if chan is closed and empty
+ */
+int chan_recv_now (uthread_chan *chan, void *elem)
+{
+  ChanWaiter *w = chan->sendq.head;
+  if (chan->count > 0)
+    {
+      chan_buffer_pop (chan, elem);
+      if (w != nullptr)
+        {
+          chan_buffer_push (chan, w->elem);
+          chan_complete (w, true);
+        }
+      return 1;
+    }
+  if (w != nullptr)
+    {
+      memcpy (elem, w->elem, chan->elem_size);
+      chan_complete (w, true);
+      return 1;
+    }
+  memset (elem, 0, chan->elem_size);
+  return 0;
+}
+
+/**
+ * copies the n channel waiters of a thread on the shared stack, and the
+ * elements they send or receive, to the heap. a peer completes them while
+ * the stack of the thread may be copied out
+ * @return the copies
+ */
+ChanWaiter *chan_copy_waiters (Thread *t, ChanWaiter *waiters, int n)
+{
+  size_t size = n * sizeof (ChanWaiter);
+  for (int i = 0; i < n; i++)
+    {
+      size += waiters[i].chan->elem_size;
+    }
+  t->chan_copy = new char[size];
+  ChanWaiter *copies = (ChanWaiter *) t->chan_copy;
+  char *elem = t->chan_copy + n * sizeof (ChanWaiter);
+  for (int i = 0; i < n; i++)
+    {
+      copies[i] = waiters[i];
+      copies[i].elem = elem;
+      if (waiters[i].send)
+        {
+          memcpy (elem, waiters[i].elem, waiters[i].chan->elem_size);
+        }
+      elem += waiters[i].chan->elem_size;
+    }
+  return copies;
+}
+
+/**
+ * makes thread t wait on the n channel waiters, without switching away
+ * from it
+ */
+void chan_park (Thread *t, ChanWaiter *waiters, int n)
+{
+  for (int i = 0; i < n; i++)
+    {
+      waiters[i].thread = t;
+      waiters[i].index = i;
+      waiters[i].ok = false;
+      chan_enqueue (waiters[i].send ? &waiters[i].chan->sendq
+                                    : &waiters[i].chan->recvq, &waiters[i]);
+    }
+  t->chan_waiters = waiters;
+  t->chan_waiter_count = n;
+  t->chan_selected = -1;
+}
+
+/**
+ * makes the running thread wait on the n channel waiters and switches to
+ * the next thread. returns once a peer completed one of them
+ * @return the index of the completed waiter
+ */
+int chan_wait (ChanWaiter *waiters, int n)
+{
+  Thread *t = threads[running_thread_id];
+  ChanWaiter *own = waiters;
+  if (shared_stack != nullptr && t->stack == shared_stack)
+    {
+      waiters = chan_copy_waiters (t, own, n);
+    }
+  chan_park (t, waiters, n);
+  switch_threads ();
+  int selected = t->chan_selected;
+  if (waiters != own)
+    {
+      for (int i = 0; i < n; i++)
+        {
+          own[i].ok = waiters[i].ok;
+        }
+      if (!own[selected].send)
+        {
+          memcpy (own[selected].elem, waiters[selected].elem,
+                  own[selected].chan->elem_size);
+        }
+      delete[] t->chan_copy;
+      t->chan_copy = nullptr;
+    }
+  return selected;
+}
+
+/**
+ * wakes the threads waiting on the fds of the events epoll reported.
+ * they try their system call again
+ */
+void io_wake (struct epoll_event *events, int n)
+{
+  for (int i = 0; i < n; i++)
+    {
+      IoFd *f = io_fds[events[i].data.fd];
+      if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        {
+          while (unpark_first (&f->readers) != nullptr);
+        }
+      if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+        {
+          while (unpark_first (&f->writers) != nullptr);
+        }
+    }
+}
+
+/**
+ * polls epoll and wakes the threads whose fds are ready
+ * @param timeout as in epoll_wait, -1 waits until an fd is ready
+ */
+void io_poll (int timeout)
+{
+  struct epoll_event events[IO_EVENTS];
+  int n = epoll_wait (epoll_fd, events, IO_EVENTS, timeout);
+  if (n == -1 && errno != EINTR)
+    {
+      handle_err ("epoll_wait err", SYS);
+    }
+  io_wake (events, n > 0 ? n : 0);
+}
+
+/**
+ * makes the running thread wait until fd can be written (write) or read,
+ * without switching away from it
+ */
+void io_register (int fd, bool write)
+{
+  if (epoll_fd == -1)
+    {
+      epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+      if (epoll_fd == -1)
+        {
+          handle_err ("epoll_create1 err", SYS);
+        }
+    }
+  if (fd >= (int) io_fds.size ())
+    {
+      io_fds.resize (fd + 1, nullptr);
+    }
+  if (io_fds[fd] == nullptr)
+    {
+      io_fds[fd] = new IoFd ();
+    }
+  if (!io_fds[fd]->registered)
+    {
+      // a dup of the fd may still be registered under this number
+      struct epoll_event ev = {};
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+      ev.data.fd = fd;
+      if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1 && errno != EEXIST)
+        {
+          handle_err ("epoll_ctl err", SYS);
+        }
+      io_fds[fd]->registered = true;
+    }
+  Thread *t = threads[running_thread_id];
+  wait_push (write ? &io_fds[fd]->writers : &io_fds[fd]->readers, t);
+  t->waits_io = true;
+  io_waiters++;
+}
+
+/**
+ * forgets that fd is in the epoll set, because its number now names
+ * another file. the fd was closed, which took it out of the set
+ */
+void io_forget (int fd)
+{
+  if (fd >= 0 && fd < (int) io_fds.size () && io_fds[fd] != nullptr)
+    {
+      io_fds[fd]->registered = false;
+    }
+}
+
+/**
+ * makes the running thread wait until fd can be written (write) or read,
+ * and switches to the next thread. returns once epoll reported fd ready
+ */
+void io_wait (int fd, bool write)
+{
+  io_register (fd, write);
+  switch_threads ();
+}
+
+/**
+ * errno of the kernel thread the caller runs on. not inlined, because the
+ * compiler may reuse the address of errno from before a switch, which in
+ * M:N mode may have moved the caller to another worker
+ */
+__attribute__ ((noinline)) int &worker_errno ()
+{
+  return errno;
+}
+
+/**
+ * @return whether a system call that returned ret failed only because it
+ * would block
+ */
+bool would_block (ssize_t ret)
+{
+  return ret == -1 && (worker_errno () == EAGAIN || worker_errno () == EWOULDBLOCK);
+}
+
+/**
+ * sets fd non-blocking, so that a system call on it that would block fails
+ * with EAGAIN instead
+ * @return 0, -1 on failure with errno set
+ */
+int set_nonblocking (int fd)
+{
+  int flags = fcntl (fd, F_GETFL);
+  if (flags == -1)
+    {
+      return -1;
+    }
+  if (flags & O_NONBLOCK)
+    {
+      return 0;
+    }
+  return fcntl (fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ * @return the monotonic time in nano-seconds
+ */
+long monotonic_ns ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/**
+ * @return the number of quantums until the next sleeping thread may wake
+ * up: the next non empty slot of the lowest wheel level, but no later than
+ * the next cascade of the levels above it
+ */
+int quantums_to_wake ()
+{
+  int idx = total_quantums & WHEEL_MASK;
+  int cascade = WHEEL_SIZE - idx;
+  for (int d = 1; d < cascade; d++)
+    {
+      if (sleep_wheel[0][(idx + d) & WHEEL_MASK] != nullptr)
+        {
+          return d;
+        }
+    }
+  return cascade;
+}
+
+/**
+ * counts the quantums of real time that passed since the library went idle,
+ * waking the threads whose sleep ends in them. the first call after a
+ * thread ran starts the count
+ */
+void idle_tick ()
+{
+  long now = monotonic_ns ();
+  if (idle_start == 0)
+    {
+      idle_start = now;
+      idle_counted = 0;
+      return;
+    }
+  long passed = (now - idle_start) / (quantum_val * 1000L) - idle_counted;
+  idle_counted += passed;
+  if (sleeping_threads == 0)
+    {
+      total_quantums += (int) passed;
+      return;
+    }
+  for (; passed > 0; passed--)
+    {
+      total_quantums++;
+      handle_sleeping ();
+    }
+}
+
+/**
+ * @return how long an idle wait may take in nano-seconds before the next
+ * sleeping thread wakes up, -1 if no thread sleeps
+ */
+long idle_timeout_ns ()
+{
+  if (sleeping_threads == 0)
+    {
+      return -1;
+    }
+  long end = idle_start
+             + (idle_counted + quantums_to_wake ()) * (quantum_val * 1000L);
+  long left = end - monotonic_ns ();
+  return left > 0 ? left : 0;
+}
+
+/**
+ * @return timeout_ns rounded up to milli-seconds, as epoll_wait takes it
+ */
+int timeout_ms (long timeout_ns)
+{
+  return timeout_ns < 0 ? -1 : (int) ((timeout_ns + 999999) / 1000000);
+}
+
+/**
+ * waits in the kernel while no thread is ready (single kernel thread mode),
+ * until a sleeping thread wakes up or an fd a thread waits for is ready.
+ * the quantum timer is stopped meanwhile, so an idle process takes no cpu
+ * @return whether a thread is ready, false if no thread sleeps or waits
+ * for I/O, so that none ever will be
+ */
+bool idle_wait ()
+{
+  if (sleeping_threads == 0 && io_waiters == 0)
+    {
+      return false;
+    }
+  trace (UTHREAD_TRACE_IDLE, -1, -1);
+  timer.it_value.tv_sec = 0;
+  timer.it_value.tv_usec = 0;
+  timer.it_interval = timer.it_value;
+  if (setitimer (quantum_timer, &timer, nullptr))
+    {
+      handle_err ("err setitimer", SYS);
+    }
+  timer_armed = false;
+
+  idle_start = 0;
+  idle_tick ();
+  while (ready_count == 0 && (sleeping_threads > 0 || io_waiters > 0))
+    {
+      long timeout = idle_timeout_ns ();
+      if (io_waiters > 0)
+        {
+          io_poll (timeout_ms (timeout));
+        }
+      else
+        {
+          struct timespec ts = {timeout / 1000000000L, timeout % 1000000000L};
+          nanosleep (&ts, nullptr);
+        }
+      idle_tick ();
+    }
+  idle_start = 0;
+  if (stats_on)
+    {
+      // the idle time is not part of the switch
+      switch_start = monotonic_ns ();
+    }
+
+  // a signal of the stopped timer may still be pending, and would cut the
+  // quantum of the next thread short
+#ifdef UTHREADS_FAST_SWITCH
+  preempt_pending = 0;
+#else
+  sigset_t pending;
+  sigpending (&pending);
+  if (sigismember (&pending, quantum_signal))
+    {
+      struct timespec zero = {0, 0};
+      sigtimedwait (&masked, nullptr, &zero);
+    }
+#endif
+  return true;
+}
+
+/* adds the value v (ns) to histogram h */
+void hist_record (uthread_hist_t *h, long v)
+{
+  unsigned long u = v > 0 ? v : 0;
+  int idx = (int) u;
+  if (u >= (1ul << UTHREAD_HIST_SUB_BITS))
+    {
+      int e = 63 - __builtin_clzl (u);
+      idx = ((e - UTHREAD_HIST_SUB_BITS + 1) << UTHREAD_HIST_SUB_BITS)
+            + (int) ((u >> (e - UTHREAD_HIST_SUB_BITS))
+                     & ((1ul << UTHREAD_HIST_SUB_BITS) - 1));
+    }
+  h->buckets[idx]++;
+  h->count++;
+  if (v > h->max)
+    {
+      h->max = v;
+    }
+}
+
+/**
+ * adaptive quantum: sets the quantum of t after a run of ran ns ended. a
+ * cpu bound thread, which is mostly preempted, gets the shortest quantum
+ * that a switch costs at most overhead_target percent of, so that it keeps
+ * the others waiting no longer than needed. a thread that mostly gives the
+ * cpu up itself gets twice its average burst, so that it is not cut short.
+ * while such a thread is preempted its current burst grows, and so does
+ * its quantum, until its bursts fit or it counts as cpu bound
+ */
+void adapt_quantum (Thread *t, long ran)
+{
+  t->burst += ran;
+  if (!preempted)
+    {
+      t->burst_avg = t->burst_avg == 0 ? t->burst : (t->burst_avg + t->burst) / 2;
+      t->burst = 0;
+    }
+  t->yield_avg += ((preempted ? 0 : 256) - t->yield_avg) / 8;
+  long cost = process_stats.switch_cost_avg_nsecs;
+  long floor = cost * (100 - overhead_target) / overhead_target / 1000;
+  long longest = t->burst > t->burst_avg ? t->burst : t->burst_avg;
+  long quantum = floor;
+  if (t->yield_avg >= 128 && 2 * longest / 1000 > floor)
+    {
+      quantum = 2 * longest / 1000;
+    }
+  quantum = quantum < quantum_min ? quantum_min : quantum;
+  t->quantum = (int) (quantum > quantum_max ? quantum_max : quantum);
+}
+
+/* ends the run of the running thread, a switch starts */
+void stats_switch_out ()
+{
+  switch_start = monotonic_ns ();
+  Thread *t = threads[running_thread_id];
+  t->stats.run_nsecs += switch_start - run_start;
+  if (adaptive)
+    {
+      adapt_quantum (t, switch_start - run_start);
+    }
+}
+
+/* the switch to the running thread is over, its run starts */
+void stats_switch_in ()
+{
+  long now = monotonic_ns ();
+  Thread *t = threads[running_thread_id];
+  hist_record (&process_stats.switch_cost, now - switch_start);
+  process_stats.switch_cost_avg_nsecs += (now - switch_start - process_stats.switch_cost_avg_nsecs) / 8;
+  t->stats.switch_nsecs += now - switch_start;
+  t->stats.switches++;
+  process_stats.switches++;
+  if (t->ready_at != 0)
+    {
+      long wait = switch_start > t->ready_at ? switch_start - t->ready_at : 0;
+      hist_record (&process_stats.ready_wait, wait);
+      t->stats.ready_nsecs += wait;
+      t->ready_at = 0;
+    }
+  run_start = now;
+}
+
+/**
+ * first function a new thread runs. leaves the critical section the switch
+ * into the thread was made in, and terminates the thread if its entry point
+ * returns
+ */
+void thread_start ()
+{
+  if (stats_on)
+    {
+      stats_switch_in ();
+    }
+  Thread *t = threads[running_thread_id];
+  real_unblock ();
+  if (t->start_routine != nullptr)
+    {
+      t->result = t->start_routine (t->arg);
+    }
+  else
+    {
+      t->entry ();
+    }
+  uthread_terminate (running_thread_id);
+  // it returned with every other thread waiting
+  handle_err ("deadlock, no thread can run", SYS);
+}
+
+#ifdef UTHREADS_FAST_SWITCH
+/**
+ * writes the frame uthread_swap_context pops when a thread first runs, so
+ * that it returns into start.
+ * @return the stack pointer to switch to
+ */
+void *initial_frame (char *stack_base, int stack_size, thread_entry_point start)
+{
+  void **sp = (void **) (((address_t) stack_base + stack_size) & ~(address_t) 15);
+  *--sp = nullptr; // return address of start, which never returns
+  *--sp = (void *) start;
+  for (int i = 0; i < 6; i++)
+    {
+      *--sp = nullptr; // rbp, rbx, r12 - r15
+    }
+  --sp;
+  ((unsigned int *) sp)[0] = INIT_MXCSR;
+  ((unsigned short *) sp)[2] = INIT_FPU_CW;
+  return sp;
+}
+
+/**
+ * @return the saved stack pointer of thread id. the initial frame of a new
+ * thread is only written when it first runs, so a thread that was spawned
+ * but never ran has not touched (and committed) any of its stack
+ */
+void *saved_sp (Thread *t)
+{
+  return t->env != nullptr ? t->env
+                           : initial_frame (t->stack, stack_size, &thread_start);
+}
+#endif
+
+/**
+ * sets up the context of t so that switching to it runs start on the given
+ * stack, inside the critical section the switch is made in
+ */
+void make_context (Thread *t, char *stack_base, int stack_size,
+                   thread_entry_point start)
+{
+#ifdef UTHREADS_FAST_SWITCH
+  // the frame of a new thread is written lazily, see saved_sp
+  t->env = start == &thread_start ? nullptr
+                                  : initial_frame (stack_base, stack_size, start);
+#else
+  address_t sp, pc;
+  sp = (address_t) stack_base + stack_size - sizeof (address_t);
+  pc = (address_t) start;
+  sigjmp_buf &env = t->env;
+  // the mask is set by hand, so saving the current one would only cost a
+  // sigprocmask call per spawn
+  sigsetjmp(env, 0);
+  (env->__jmpbuf)[JB_SP] = (long) translate_address (sp);
+  (env->__jmpbuf)[JB_PC] = (long) translate_address (pc);
+  env->__mask_was_saved = 1;
+  env->__saved_mask = masked;
+#endif
+}
+
+/**
+ * saves the context of thread from and continues thread to.
+ * returns when thread from is switched back to
+ */
+void switch_context (Thread *from, Thread *to)
+{
+  // stackless tasks are all continued by the runner, which keeps its place
+  from = from->stackless ? &coro_runner : from;
+  to = to->stackless ? &coro_runner : to;
+  if (from == to)
+    {
+      return;
+    }
+  if (shared_stack != nullptr && to->stack == shared_stack && stack_owner != to)
+    {
+      stack_next = to;
+      to = &copier;
+    }
+#ifdef UTHREADS_FAST_SWITCH
+  uthread_swap_context (&from->env, saved_sp (to));
+#else
+  // to is live across sigsetjmp, so it must not be kept in a register
+  Thread *volatile next = to;
+  if (!sigsetjmp(from->env, 1))
+    {
+      siglongjmp (next->env, 1);
+    }
+#endif
+}
+
+/**
+ * continues thread to without saving the current context
+ */
+void jump_context (Thread *to)
+{
+  to = to->stackless ? &coro_runner : to;
+  if (shared_stack != nullptr && to->stack == shared_stack && stack_owner != to)
+    {
+      stack_next = to;
+      to = &copier;
+    }
+#ifdef UTHREADS_FAST_SWITCH
+  void *discarded;
+  uthread_swap_context (&discarded, saved_sp (to));
+#else
+  siglongjmp (to->env, 1);
+#endif
+}
+
+/* @return the stack pointer thread t was switched out at */
+char *switched_out_sp (Thread *t)
+{
+#ifdef UTHREADS_FAST_SWITCH
+  return (char *) t->env;
+#else
+  return (char *) untranslate_address ((t->env->__jmpbuf)[JB_SP]);
+#endif
+}
+
+/**
+ * loop of the context that hands the shared stack over to stack_next
+ * (shared stack mode). it runs on a stack of its own, so that it may
+ * overwrite the shared one: it copies the used part of the stack out for
+ * the thread that had it, copies the part of stack_next back in, and
+ * switches to stack_next. buffers are sized to what the thread uses
+ */
+void copier_start ()
+{
+  char *top = shared_stack + stack_size;
+  for (;;)
+    {
+      Thread *t = stack_owner;
+      if (t != nullptr)
+        {
+          char *sp = switched_out_sp (t);
+          size_t used = top - sp;
+          if (used > t->saved_capacity || used < t->saved_capacity / 4)
+            {
+              delete[] t->saved_stack;
+              t->saved_stack = new char[used];
+              t->saved_capacity = used;
+            }
+          memcpy (t->saved_stack, sp, used);
+          t->saved_size = used;
+        }
+      t = stack_next;
+      if (t->saved_size > 0)
+        {
+          memcpy (top - t->saved_size, t->saved_stack, t->saved_size);
+        }
+      stack_owner = t;
+      switch_context (&copier, t);
+    }
+}
+
+/**
+ * starts the quantum of the thread that was just made running: a one shot
+ * quantum_timer, or the timer of the worker in M:N mode.
+ * in tickless mode the periodic timer is left running, so the thread gets
+ * what is left of the current period
+ */
+void arm_quantum ()
+{
+  if (num_workers > 1)
+    {
+      if (tickless && this_worker->timer_armed)
+        {
+          return;
+        }
+      struct itimerspec its = {};
+      its.it_value.tv_sec = quantum_val / 1000000;
+      its.it_value.tv_nsec = (long) (quantum_val % 1000000) * 1000;
+      if (tickless)
+        {
+          its.it_interval = its.it_value;
+        }
+      if (timer_settime (this_worker->timer, 0, &its, nullptr))
+        {
+          handle_err ("err timer_settime", SYS);
+        }
+      this_worker->timer_armed = tickless;
+      return;
+    }
+  if (tickless)
+    {
+      update_tick ();
+      return;
+    }
+  int quantum = quantum_val;
+  if (adaptive && threads[running_thread_id]->quantum > 0)
+    {
+      quantum = threads[running_thread_id]->quantum;
+    }
+  timer.it_value.tv_sec = quantum / 1000000;
+  timer.it_value.tv_usec = quantum % 1000000;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = 0;
+
+  if (setitimer (quantum_timer, &timer, nullptr))
+    {
+      handle_err ("err setitimer", SYS);
+    }
+}
+
+/**
+ * waits until work may have been pushed to a deque (M:N mode). called from
+ * the scheduling loop of w, the library lock is left while waiting
+ */
+void worker_idle (Worker *w)
+{
+  // an idle worker is not preempted, and a stale signal would cut the
+  // quantum of the next thread short
+  struct itimerspec off = {};
+  timer_settime (w->timer, 0, &off, nullptr);
+  w->timer_armed = false;
+
+  // the last worker to go idle counts the quantums sleeping threads wait
+  // for in real time, and wakes up when the next one is due
+  long wait_ns = IDLE_WAIT_NSECS;
+  bool clock = sleeping_threads > 0 && idle_workers.load () == num_workers - 1;
+  if (clock)
+    {
+      idle_tick ();
+      long timeout = idle_timeout_ns ();
+      wait_ns = timeout < wait_ns ? timeout : wait_ns;
+    }
+
+  // with threads waiting for I/O the worker waits on epoll instead, the
+  // short timeout bounds how late it sees pushed work
+  struct epoll_event events[IO_EVENTS];
+  int n = 0;
+  bool poll_io = io_waiters > 0;
+  int seq = work_seq.load ();
+  idle_workers.fetch_add (1);
+  unlock_library ();
+  if (!work_available ())
+    {
+      if (poll_io)
+        {
+          n = epoll_wait (epoll_fd, events, IO_EVENTS, timeout_ms (wait_ns));
+        }
+      else
+        {
+          struct timespec timeout = {0, wait_ns};
+          syscall (SYS_futex, (int *) &work_seq, FUTEX_WAIT_PRIVATE, seq,
+                   &timeout, nullptr, 0);
+        }
+    }
+  idle_workers.fetch_sub (1);
+  lock_library ();
+  io_wake (events, n > 0 ? n : 0);
+  if (clock)
+    {
+      idle_tick ();
+    }
+}
+
+/**
+ * scheduling loop of worker w (M:N mode). runs inside a critical section:
+ * a thread that stops running switches here, and the loop switches to the
+ * next ready thread. the loop of a worker is never moved to another one
+ */
+void worker_loop (Worker *w)
+{
+  for (;;)
+    {
+      if (w->zombie != -1)
+        {
+          // off the cpu now, its values go to the thread terminating it
+          Thread *z = threads[w->zombie];
+          if (z->terminator.head != nullptr)
+            {
+              take_specific (z, z->doomed_values);
+            }
+          delete_thread (w->zombie);
+          w->zombie = -1;
+        }
+      if (io_waiters > 0 && total_quantums % IO_POLL_QUANTUMS == 0)
+        {
+          io_poll (0);
+        }
+      int next = take_ready (w);
+      if (next == -1)
+        {
+          if (!w->idle_traced)
+            {
+              trace (UTHREAD_TRACE_IDLE, -1, -1);
+              w->idle_traced = true;
+            }
+          worker_idle (w);
+          continue;
+        }
+      w->idle_traced = false;
+      idle_start = 0;
+      Thread *t = threads[next];
+      running_thread_id = next;
+      running_specific = t->specific;
+      running_arena = &t->arena;
+      t->running = true;
+      total_quantums++;
+      t->inc_quantums ();
+      handle_sleeping ();
+#ifdef UTHREADS_FAST_SWITCH
+      preempt_pending = 0;
+#endif
+      arm_quantum ();
+      trace (UTHREAD_TRACE_SWITCH, next, -1);
+      switch_context (&w->loop, t);
+    }
+}
+
+/* the loop of worker 0, which runs on a stack from the pool */
+void loop_start ()
+{
+  worker_loop (this_worker);
+}
+
+/**
+ * creates the cpu time timer of the calling worker
+ */
+void create_worker_timer (Worker *w)
+{
+  struct sigevent sev = {};
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = quantum_signal;
+  sev.sigev_notify_thread_id = gettid ();
+  clockid_t clock = quantum_timer == ITIMER_REAL ? CLOCK_MONOTONIC
+                                                 : CLOCK_THREAD_CPUTIME_ID;
+  if (timer_create (clock, &sev, &w->timer))
+    {
+      handle_err ("err timer_create", SYS);
+    }
+}
+
+/* the kernel threads of workers 1 and up */
+void *worker_main (void *arg)
+{
+  Worker *w = (Worker *) arg;
+  this_worker = w;
+  running_thread_id = -1;
+  create_worker_timer (w);
+  real_block ();
+  worker_loop (w);
+  return nullptr;
+}
+
+/**
+ * starts the workers of M:N mode. the calling kernel thread is worker 0 and
+ * keeps running the main thread
+ */
+void start_workers ()
+{
+  workers = new Worker *[num_workers];
+  for (int i = 0; i < num_workers; i++)
+    {
+      workers[i] = new Worker;
+      workers[i]->index = i;
+    }
+  this_worker = workers[0];
+  create_worker_timer (workers[0]);
+  make_context (&workers[0]->loop, stack_alloc (), stack_size, &loop_start);
+  for (int i = 1; i < num_workers; i++)
+    {
+      if (pthread_create (&workers[i]->pthread, nullptr, &worker_main, workers[i]))
+        {
+          handle_err ("pthread_create err", SYS);
+        }
+    }
+}
+
+/**
+ * stops the running thread for good (M:N mode). the loop of the worker
+ * deletes it, another worker may reuse its stack as soon as it is freed
+ */
+void exit_to_loop ()
+{
+  threads[running_thread_id]->running = false;
+  this_worker->zombie = running_thread_id;
+  running_thread_id = -1;
+  jump_context (&this_worker->loop);
+}
+
+/**
+ * stops the running thread (M:N mode) and switches to the scheduling loop
+ * of the worker. a thread that is still runnable is pushed to the worker's
+ * deque first. returns when the thread is switched back to, possibly by
+ * another worker
+ */
+void switch_to_loop ()
+{
+  Thread *t = threads[running_thread_id];
+  if (t->doomed)
+    {
+      exit_to_loop ();
+    }
+  if (t->runnable ())
+    {
+      return_to_ready (running_thread_id);
+    }
+  t->running = false;
+  running_thread_id = -1;
+  switch_context (t, &this_worker->loop);
+}
+
+/**
+ * removes the next thread to run from the ready queue. threads waiting for
+ * I/O are polled every IO_POLL_QUANTUMS quantums, and when no thread is
+ * ready the process idles until one is
+ * @return the id of the thread, -1 if no thread is ready and none can
+ * become ready
+ */
+int next_ready ()
+{
+  if (io_waiters > 0 && ready_count > 0
+      && total_quantums % IO_POLL_QUANTUMS == 0)
+    {
+      io_poll (0);
+    }
+  if (ready_count == 0 && !idle_wait ())
+    {
+      return -1;
+    }
+  return pop_ready ();
+}
+
+/**
+ * makes a scheduling decision and switches to the next thread. the caller
+ * is inside a critical section, which the thread switched to leaves
+ */
+void switch_threads ()
+{
+#ifdef UTHREADS_FAST_SWITCH
+  preempt_pending = 0;
+#endif
+  if (stackless_running)
+    {
+      // its place is on the stack of the runner, which the next task reuses
+      handle_err ("a stackless task can only wait with co_await", SYS);
+    }
+
+  if (num_workers > 1)
+    {
+      switch_to_loop ();
+      return;
+    }
+  if (stats_on)
+    {
+      stats_switch_out ();
+    }
+
+  if (threads[running_thread_id]->edf_period > 0)
+    {
+      edf_account (threads[running_thread_id]);
+    }
+  else if (policy == UTHREAD_POLICY_MLFQ)
+    {
+      mlfq_account (threads[running_thread_id]);
+    }
+  else if (policy == UTHREAD_POLICY_STRIDE)
+    {
+      threads[running_thread_id]->pass += STRIDE_ONE / threads[running_thread_id]->tickets;
+    }
+  if (policy == UTHREAD_POLICY_MLFQ
+      && total_quantums - last_aging >= MLFQ_AGING_QUANTUMS)
+    {
+      mlfq_age ();
+      last_aging = total_quantums;
+    }
+  preempted = false;
+
+  int prev_thread_id = running_thread_id;
+  if (threads[running_thread_id]->runnable ())
+    {
+      return_to_ready (running_thread_id);
+    }
+  threads[running_thread_id]->running = false;
+  running_thread_id = next_ready ();
+  if (running_thread_id == -1)
+    {
+      // every thread waits on another one
+      handle_err ("deadlock, no thread can run", SYS);
+    }
+  running_specific = threads[running_thread_id]->specific;
+  running_arena = &threads[running_thread_id]->arena;
+  threads[running_thread_id]->running = true;
+  total_quantums++;
+  threads[running_thread_id]->inc_quantums ();
+  handle_sleeping();
+  arm_quantum ();
+
+  trace (UTHREAD_TRACE_SWITCH, running_thread_id, prev_thread_id);
+  if (running_thread_id != prev_thread_id)
+    {
+      switch_context (threads[prev_thread_id], threads[running_thread_id]);
+    }
+  if (stats_on)
+    {
+      stats_switch_in ();
+    }
+}
+
+/* called only by the system - means a quantum has passed */
+void scheduler (int sig)
+{
+  real_block ();
+  preempted = true;
+  Thread *t = threads[running_thread_id];
+  if (t != nullptr && t->stackless)
+    {
+      // a stackless task has no stack to keep its place on, and runs until
+      // it suspends
+#ifdef UTHREADS_FAST_SWITCH
+      preempt_pending = 0;
+#endif
+      real_unblock ();
+      return;
+    }
+  switch_threads ();
+  real_unblock ();
+}
+
+/**
+ * the quantum_signal handler. with the fast switch backend the signal is not
+ * masked inside critical sections, so the switch is deferred to the end of
+ * the critical section it interrupted
+ */
+void timer_handler (int sig)
+{
+#ifdef UTHREADS_FAST_SWITCH
+  if (in_critical)
+    {
+      preempt_pending = 1;
+      return;
+    }
+#endif
+  scheduler (sig);
+}
+
+// in case a thread terminates itself
+void terminated_switch ()
+{
+  if (num_workers > 1)
+    {
+      exit_to_loop ();
+    }
+  int terminated_thread = running_thread_id;
+  bool stackless = threads[terminated_thread]->stackless;
+  if (stats_on)
+    {
+      stats_switch_out ();
+    }
+
+  threads[running_thread_id]->running = false;
+  running_thread_id = next_ready ();
+  if (running_thread_id == -1)
+    {
+      // every thread waits on another one
+      handle_err ("deadlock, no thread can run", SYS);
+    }
+  running_specific = threads[running_thread_id]->specific;
+  running_arena = &threads[running_thread_id]->arena;
+  threads[running_thread_id]->running = true;
+  total_quantums++;
+  threads[running_thread_id]->inc_quantums ();
+  handle_sleeping();
+
+  delete_thread (terminated_thread);
+  trace (UTHREAD_TRACE_SWITCH, running_thread_id, terminated_thread);
+
+  arm_quantum ();
+  if (!stackless)
+    {
+      jump_context (threads[running_thread_id]);
+    }
+  // a stackless task ended on the stack of the runner, which returns to its
+  // loop once a stackless task runs again
+  switch_context (&coro_runner, threads[running_thread_id]);
+  if (stats_on)
+    {
+      stats_switch_in ();
+    }
+
+
+//  make_switch ();
+
+}
+
+// in case a thread blocked itself
+//void sleep_or_blocked_switch ()
+//{
+//  if (sigsetjmp(env[running_thread_id], 1) == 1)
+//    {
+//      real_unblock ();
+//      return;
+//    }
+//  make_switch ();
+//}
+
+/**
+ * @brief initializes the thread library.
+ *
+ * You may assume that this function is called before any other thread library function, and that it is called
+ * exactly once.
+ * The input to the function is the length of a quantum in micro-seconds.
+ * It is an error to call this function with non-positive quantum_usecs.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init (int quantum_usecs)
+{
+  uthread_attr attr = {};
+  attr.quantum_usecs = quantum_usecs;
+  return uthread_init_attr (&attr);
+}
+
+/**
+ * @brief initializes the thread library with the options in attr.
+ *
+ * Fields of attr left 0 take their default value.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_attr (const uthread_attr *attr)
+{
+
+  // every field is checked before the critical section, which a failure
+  // would leave held
+  if (attr->quantum_usecs <= 0)
+    {
+      handle_err ("invalid quantum_usecs", LIB);
+      return -1;
+    }
+  if (attr->stack_size < 0)
+    {
+      handle_err ("invalid stack_size", LIB);
+      return -1;
+    }
+  if (attr->max_threads < 0 || attr->max_threads == 1)
+    {
+      handle_err ("invalid max_threads", LIB);
+      return -1;
+    }
+  if (attr->workers < 0)
+    {
+      handle_err ("invalid workers", LIB);
+      return -1;
+    }
+  if (attr->policy != UTHREAD_POLICY_RR && attr->policy != UTHREAD_POLICY_MLFQ
+      && attr->policy != UTHREAD_POLICY_STRIDE)
+    {
+      handle_err ("invalid policy", LIB);
+      return -1;
+    }
+  if (attr->policy != UTHREAD_POLICY_RR && attr->workers > 1)
+    {
+      handle_err ("policy needs a single worker", LIB);
+      return -1;
+    }
+  if (attr->stats && attr->workers > 1)
+    {
+      handle_err ("stats need a single worker", LIB);
+      return -1;
+    }
+  if (attr->trace_events < 0)
+    {
+      handle_err ("invalid trace_events", LIB);
+      return -1;
+    }
+  if (attr->quantum_max_usecs < 0 || attr->quantum_min_usecs < 0
+      || (attr->quantum_max_usecs > 0 && attr->quantum_min_usecs > attr->quantum_max_usecs)
+      || attr->overhead_percent < 0 || attr->overhead_percent >= 100)
+    {
+      handle_err ("invalid adaptive quantum bounds", LIB);
+      return -1;
+    }
+  if (attr->quantum_max_usecs > 0 && (attr->workers > 1 || attr->tickless))
+    {
+      handle_err ("the adaptive quantum needs a single worker and no tickless mode", LIB);
+      return -1;
+    }
+  if (attr->shared_stack && attr->workers > 1)
+    {
+      handle_err ("a shared stack needs a single worker", LIB);
+      return -1;
+    }
+  if (attr->wall_clock)
+    {
+      quantum_timer = ITIMER_REAL;
+      quantum_signal = SIGALRM;
+    }
+  else
+    {
+      quantum_timer = ITIMER_VIRTUAL;
+      quantum_signal = SIGVTALRM;
+    }
+  sigemptyset (&masked);
+  sigaddset (&masked, quantum_signal);
+  real_block ();
+
+  quantum_val = attr->quantum_usecs;
+  tickless = attr->tickless != 0;
+  policy = attr->policy;
+  adaptive = attr->quantum_max_usecs > 0;
+  stats_on = attr->stats != 0 || adaptive;
+  quantum_min = attr->quantum_min_usecs > 0 ? attr->quantum_min_usecs : 1;
+  quantum_max = attr->quantum_max_usecs;
+  overhead_target = attr->overhead_percent > 0 ? attr->overhead_percent : 1;
+  if (attr->trace_events > 0)
+    {
+      unsigned long size = 1;
+      while (size < (unsigned long) attr->trace_events)
+        {
+          size <<= 1;
+        }
+      trace_ring = new TraceSlot[size] ();
+      trace_mask = size - 1;
+    }
+  run_start = monotonic_ns ();
+  max_threads = attr->max_threads > 0 ? attr->max_threads : MAX_THREAD_NUM;
+  num_workers = attr->workers > 0 ? attr->workers : 1;
+  if (num_workers > 1)
+    {
+      // real_block above was entered before the lock was in use
+      lock_library ();
+    }
+  // one more stack for the scheduling loop of worker 0. with a shared
+  // stack, only it and the stack of the copier
+  stack_pool_init (attr->stack_size > 0 ? attr->stack_size : STACK_SIZE,
+                   attr->shared_stack ? 2 : max_threads + (num_workers > 1));
+  if (attr->shared_stack)
+    {
+      shared_stack = stack_alloc ();
+      make_context (&copier, stack_alloc (), stack_size, &copier_start);
+    }
+
+  sa.sa_handler = &timer_handler;
+#ifdef UTHREADS_FAST_SWITCH
+  // the handler switches threads without returning, so it must not leave
+  // the signal masked in the thread it switches to
+  sa.sa_flags = SA_NODEFER;
+#endif
+  if (sigaction (quantum_signal, &sa, nullptr) < 0)
+    {
+      handle_err ("sigaction err", SYS);
+    }
+
+  threads.create (0);
+  running_thread_id = 0;
+  running_specific = threads[0]->specific;
+  running_arena = &threads[0]->arena;
+  threads[0]->running = true;
+
+#ifndef UTHREADS_FAST_SWITCH
+  sigjmp_buf &env = threads[0]->env;
+  sigsetjmp(env, 1);
+  (env->__jmpbuf)[JB_SP] = (long) __builtin_frame_address (0);
+  (env->__jmpbuf)[JB_PC] = (long) __builtin_return_address (0);
+  sigemptyset (&env->__saved_mask);
+#endif
+
+  if (num_workers > 1)
+    {
+      start_workers ();
+    }
+  arm_quantum ();
+
+  threads[0]->inc_quantums ();
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * creates a thread that starts from entry, or from routine(arg) as a
+ * joinable thread. the caller is inside a critical section
+ * @return the ID of the thread, -1 on failure
+ */
+int spawn_thread (thread_entry_point entry, void *(*routine) (void *), void *arg, int priority)
+{
+  if (entry == nullptr && routine == nullptr)
+    {
+      handle_err ("entry point is null", LIB);
+      return -1;
+    }
+  if (priority < 0 || priority >= UTHREAD_PRIORITIES)
+    {
+      handle_err ("invalid priority", LIB);
+      return -1;
+    }
+
+  int new_id = generate_id ();
+  if (new_id == -1)
+    {
+      return -1;
+    }
+  char *stack = shared_stack != nullptr ? shared_stack : stack_alloc ();
+  if (stack == nullptr)
+    {
+      available_ids.push (new_id);
+      return -1;
+    }
+  Thread *t = threads.create (new_id);
+  t->stack = stack;
+  t->entry = entry;
+  t->start_routine = routine;
+  t->arg = arg;
+  t->joinable = routine != nullptr;
+  t->priority = priority;
+  t->born = total_quantums;
+  if (policy == UTHREAD_POLICY_MLFQ)
+    {
+      t->level = priority;
+    }
+  make_context (t, t->stack, stack_size, &thread_start);
+
+  return_to_ready (new_id);
+  trace (UTHREAD_TRACE_SPAWN, new_id, running_thread_id);
+  return new_id;
+}
+
+/**
+ * @brief Creates a new thread, whose entry point is the function entry_point with the signature
+ * void entry_point(void).
+ *
+ * The thread is added to the end of the READY threads list.
+ * The uthread_spawn function should fail if it would cause the number of concurrent threads to exceed the
+ * limit (MAX_THREAD_NUM, or the max_threads given to uthread_init_attr).
+ * Each thread should be allocated with a stack of size STACK_SIZE bytes (or the stack_size given to
+ * uthread_init_attr).
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn (thread_entry_point entry_point)
+{
+  return uthread_spawn_prio (entry_point, 0);
+}
+
+/**
+ * @brief Creates a new thread like uthread_spawn, with the given priority.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_prio (thread_entry_point entry_point, int priority)
+{
+  real_block ();
+  int new_id = spawn_thread (entry_point, nullptr, nullptr, priority);
+  real_unblock ();
+  return new_id;
+}
+
+/**
+ * @brief Creates a new joinable thread that runs start_routine(arg).
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_arg (void *(*start_routine) (void *), void *arg)
+{
+  real_block ();
+  int new_id = spawn_thread (nullptr, start_routine, arg, 0);
+  real_unblock ();
+  return new_id;
+}
+
+/**
+ * @brief Creates count threads like uthread_spawn, all in one critical section.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_spawn_n (thread_entry_point entry_point, int count, int *tids)
+{
+  real_block ();
+
+  if (entry_point == nullptr)
+    {
+      handle_err ("entry point is null", LIB);
+      real_unblock ();
+      return -1;
+    }
+  if (count < 0)
+    {
+      handle_err ("negative count in spawn_n func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  // all or none, so the ID's are counted before any is taken
+  if (count > (long) available_ids.size () + max_threads - next_new_id)
+    {
+      handle_err ("you've reached max num of threads", LIB);
+      real_unblock ();
+      return -1;
+    }
+  if (shared_stack == nullptr && !stack_reserve (count))
+    {
+      real_unblock ();
+      return -1;
+    }
+  for (int i = 0; i < count; i++)
+    {
+      int new_id = spawn_thread (entry_point, nullptr, nullptr, 0);
+      if (tids != nullptr)
+        {
+          tids[i] = new_id;
+        }
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Terminates the thread with ID tid and deletes it from all relevant control structures.
+ *
+ * All the resources allocated by the library for this thread should be released. If no thread with ID tid exists it
+ * is considered an error. Terminating the main thread (tid == 0) will result in the termination of the entire
+ * process using exit(0) (after releasing the assigned library memory).
+ *
+ * @return The function returns 0 if the thread was successfully terminated and -1 otherwise. If a thread terminates
+ * itself or the main thread is terminated, the function does not return.
+*/
+int uthread_terminate (int tid)
+{
+  if (tid == running_thread_id && stackless_running)
+    {
+      handle_err ("a stackless task ends by returning", LIB);
+      return -1;
+    }
+  real_block ();
+  if (threads[tid] == nullptr)
+    {
+      handle_err ("no such tid in terminate func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  trace (UTHREAD_TRACE_TERMINATE, tid, running_thread_id);
+  if (tid == 0)
+    {
+      free_memory ();
+      exit (0);
+    }
+  if (tid == running_thread_id && last_runnable ()
+      && threads[tid]->joiners.head == nullptr)
+    {
+      // every other thread waits for one that only this thread can wake
+      handle_err ("deadlock, no other thread is ready", LIB);
+      real_unblock ();
+      return -1;
+    }
+  // the values of the thread, destroyed once it is off the cpu
+  void *values[UTHREAD_KEYS_MAX] = {};
+  bool destroy = false;
+  if (tid == running_thread_id)
+    {
+      if (keys_created > 0)
+        {
+          // on its own stack, where a destructor may set values again
+          real_unblock ();
+          destroy_specific (tid);
+          real_block ();
+        }
+      // the joining thread is ready before the next thread is picked
+      hand_result (threads[tid]);
+      terminated_switch ();
+    }
+  else if (threads[tid]->doomed)
+    {
+      // already being terminated by another thread
+    }
+  else if (threads[tid]->running)
+    {
+      // running on another worker, which deletes it when it stops and
+      // hands its values over
+      threads[tid]->doomed = true;
+      if (keys_created > 0)
+        {
+          threads[tid]->doomed_values = values;
+          destroy = park (&threads[tid]->terminator) == 0;
+        }
+    }
+  else
+    {
+      if (threads[tid]->ready)
+        {
+          remove_from_ready (tid);
+        }
+      destroy = keys_created > 0 && take_specific (threads[tid], values);
+      delete_thread (tid);
+    }
+  real_unblock ();
+  if (destroy)
+    {
+      run_destructors (values);
+    }
+  return 0;
+}
+
+/**
+ * @brief Waits for the joinable thread with ID tid to terminate, and stores the value its start routine returned
+ * in *ret if ret is not nullptr (nullptr if the thread was terminated by uthread_terminate).
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_join (int tid, void **ret)
+{
+  real_block ();
+  void *result = nullptr;
+  auto exited = exited_results.find (tid);
+  Thread *t = threads[tid];
+  if (exited != exited_results.end ())
+    {
+      result = exited->second;
+      exited_results.erase (exited);
+      available_ids.push (tid);
+    }
+  else if (t == nullptr)
+    {
+      handle_err ("no such tid in join func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  else if (tid == running_thread_id)
+    {
+      handle_err ("a thread cannot join itself", LIB);
+      real_unblock ();
+      return -1;
+    }
+  else if (!t->joinable)
+    {
+      handle_err ("the thread is not joinable", LIB);
+      real_unblock ();
+      return -1;
+    }
+  else if (t->joiners.head != nullptr)
+    {
+      handle_err ("the thread is already joined", LIB);
+      real_unblock ();
+      return -1;
+    }
+  else
+    {
+      if (park (&t->joiners) == -1)
+        {
+          real_unblock ();
+          return -1;
+        }
+      result = threads[running_thread_id]->join_result;
+    }
+  if (ret != nullptr)
+    {
+      *ret = result;
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Makes the joinable thread with ID tid not joinable, so that nothing is kept once it terminates.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_detach (int tid)
+{
+  real_block ();
+  auto exited = exited_results.find (tid);
+  if (exited != exited_results.end ())
+    {
+      exited_results.erase (exited);
+      available_ids.push (tid);
+    }
+  else if (threads[tid] == nullptr || !threads[tid]->joinable)
+    {
+      handle_err ("no joinable thread with this tid", LIB);
+      real_unblock ();
+      return -1;
+    }
+  else
+    {
+      threads[tid]->joinable = false;
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Blocks the thread with ID tid. The thread may be resumed later using uthread_resume.
+ *
+ * If no thread with ID tid exists it is considered as an error. In addition, it is an error to try blocking the
+ * main thread (tid == 0). If a thread blocks itself, a scheduling decision should be made. Blocking a thread in
+ * BLOCKED state has no effect and is not considered an error.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_block (int tid)
+{
+  real_block ();
+
+  if (threads[tid] == nullptr)
+    {
+      handle_err ("no such tid in block func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  else if (tid == 0)
+    {
+      handle_err ("trying block the main thread", LIB);
+      real_unblock ();
+      return -1;
+    }
+  else if (tid == running_thread_id)
+    {
+      // no other thread could resume it
+      if (!may_park ())
+        {
+          real_unblock ();
+          return -1;
+        }
+      trace (UTHREAD_TRACE_BLOCK, tid, running_thread_id);
+      threads[tid]->block ();
+      switch_threads ();
+    }
+  else if (!threads[tid]->is_blocked ())
+    {
+      trace (UTHREAD_TRACE_BLOCK, tid, running_thread_id);
+      threads[tid]->block ();
+      // remove from ready queue. a thread running on another worker stops
+      // at the end of its quantum
+      if (threads[tid]->ready){
+        remove_from_ready (tid);
+      }
+
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * moves a blocked thread to the ready queue. a thread that also sleeps or
+ * waits only loses its blocked mark. the caller is inside a critical
+ * section
+ */
+void resume_thread (int tid)
+{
+  trace (UTHREAD_TRACE_RESUME, tid, running_thread_id);
+
+  if (!threads[tid]->is_sleeping () &&
+      !threads[tid]->is_parked () &&
+      !threads[tid]->ready &&
+      !threads[tid]->running &&
+      threads[tid]->is_blocked ())
+    {
+      threads[tid]->unblock ();
+      return_to_ready (tid);
+    }
+  else
+    {
+      // sleeping, waiting, or blocked while still running on another worker
+      threads[tid]->unblock ();
+    }
+}
+
+/**
+ * @brief Resumes a blocked thread with ID tid and moves it to the READY state.
+ *
+ * Resuming a thread in a RUNNING or READY state has no effect and is not considered as an error. If no thread with
+ * ID tid exists it is considered an error.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_resume (int tid)
+{
+  real_block ();
+
+  if (threads[tid] == nullptr)
+    {
+      handle_err ("no such tid in resume func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  resume_thread (tid);
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Resumes the count threads with the ID's in tids like uthread_resume, all in one critical section.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_resume_n (const int *tids, int count)
+{
+  real_block ();
+
+  if (count < 0 || (count > 0 && tids == nullptr))
+    {
+      handle_err ("invalid tids in resume_n func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  // all or none, so the ID's are checked before any thread is resumed
+  for (int i = 0; i < count; i++)
+    {
+      if (threads[tids[i]] == nullptr)
+        {
+          handle_err ("no such tid in resume_n func", LIB);
+          real_unblock ();
+          return -1;
+        }
+    }
+  for (int i = 0; i < count; i++)
+    {
+      resume_thread (tids[i]);
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * puts the running thread in the timer wheel for num_quantums quantums,
+ * without switching away from it
+ */
+void sleep_running (int num_quantums)
+{
+  trace (UTHREAD_TRACE_SLEEP, running_thread_id, num_quantums);
+  threads[running_thread_id]->wake_quantum = total_quantums + num_quantums;
+  wheel_insert (threads[running_thread_id]);
+  sleeping_threads++;
+}
+
+/**
+ * @brief Blocks the RUNNING thread for num_quantums quantnums.
+ *
+ * Immediately after the RUNNING thread transitions to the BLOCKED state a scheduling decision should be made.
+ * After the sleeping time is over, the thread should go back to the end of the READY threads list.
+ * The number of quantnums refers to the number of times a new quantum starts, regardless of the reason. Specifically,
+ * the quantum of the thread which has made the call to uthread_sleep isn’t counted.
+ * It is considered an error if the main thread (tid==0) calls this function.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sleep (int num_quantums)
+{
+  real_block ();
+
+  if (running_thread_id == 0)
+    {
+      handle_err ("main thread can't sleep", LIB);
+      real_unblock ();
+      return -1;
+    }
+  else if (num_quantums > 0)
+    {
+//      sleep_or_blocked_switch ();
+      sleep_running (num_quantums);
+      switch_threads ();
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Moves the RUNNING thread to the end of the READY threads list and makes a scheduling decision.
+ *
+ * A new quantum starts, as if the quantum of the calling thread had expired. If no other thread is READY the calling
+ * thread keeps running.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_yield ()
+{
+  real_block ();
+  switch_threads ();
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Returns the thread ID of the calling thread.
+ *
+ * @return The ID of the calling thread.
+*/
+int uthread_get_tid ()
+{ return running_thread_id; }
+
+/**
+ * @brief Returns the total number of quantnums since the library was initialized, including the current quantum.
+ *
+ * Right after the call to uthread_init, the value should be 1.
+ * Each time a new quantum starts, regardless of the reason, this number should be increased by 1.
+ *
+ * @return The total number of quantnums.
+*/
+int uthread_get_total_quantums ()
+{ return total_quantums; }
+
+/**
+ * @brief Returns the number of quantnums the thread with ID tid was in RUNNING state.
+ *
+ * On the first time a thread runs, the function should return 1. Every additional quantum that the thread starts should
+ * increase this value by 1 (so if the thread with ID tid is in RUNNING state when this function is called, include
+ * also the current quantum). If no thread with ID tid exists it is considered an error.
+ *
+ * @return On success, return the number of quantnums of the thread with ID tid. On failure, return -1.
+*/
+int uthread_get_quantums (int tid)
+{
+  real_block ();
+
+  if (threads[tid] == nullptr)
+    {
+      handle_err ("no such tid in get_quantum func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  int num = threads[tid]->get_quantums ();
+  real_unblock ();
+  return num;
+}
+
+/**
+ * @brief Returns the number of periods of the EDF thread with ID tid that ended before the thread completed its job.
+ *
+ * @return On success, return the number of deadline misses of the thread with ID tid. On failure, return -1.
+*/
+int uthread_get_deadline_misses (int tid)
+{
+  real_block ();
+
+  if (threads[tid] == nullptr)
+    {
+      handle_err ("no such tid in get_deadline_misses func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  int num = threads[tid]->deadline_misses;
+  real_unblock ();
+  return num;
+}
+
+/**
+ * @brief Returns the share of the cpu the thread with ID tid received since it was spawned.
+ *
+ * @return On success, return a share between 0 and 1. On failure, return -1.
+*/
+double uthread_get_share (int tid)
+{
+  real_block ();
+
+  if (threads[tid] == nullptr)
+    {
+      handle_err ("no such tid in get_share func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  int lifetime = total_quantums - threads[tid]->born;
+  double share = lifetime > 0 ? (double) threads[tid]->get_quantums () / lifetime : 0;
+  real_unblock ();
+  return share;
+}
+
+/**
+ * @brief Copies the time statistics of the process to stats.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_stats (uthread_stats_t *stats)
+{
+  real_block ();
+  if (!stats_on)
+    {
+      handle_err ("stats are off", LIB);
+      real_unblock ();
+      return -1;
+    }
+  *stats = process_stats;
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Copies the time statistics of the thread with ID tid to stats.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_thread_stats (int tid, uthread_thread_stats_t *stats)
+{
+  real_block ();
+  if (!stats_on)
+    {
+      handle_err ("stats are off", LIB);
+      real_unblock ();
+      return -1;
+    }
+  if (threads[tid] == nullptr)
+    {
+      handle_err ("no such tid in thread_stats func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  *stats = threads[tid]->stats;
+  stats->quantum_usecs = quantum_val;
+  if (adaptive && threads[tid]->quantum > 0)
+    {
+      stats->quantum_usecs = threads[tid]->quantum;
+    }
+  if (tid == running_thread_id)
+    {
+      stats->run_nsecs += monotonic_ns () - run_start;
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Returns the value below which the given percentile of the values in hist fall.
+ *
+ * @return the value in nanoseconds, 0 if hist is empty.
+*/
+long uthread_hist_percentile (const uthread_hist_t *hist, double percentile)
+{
+  if (hist->count == 0)
+    {
+      return 0;
+    }
+  long target = (long) (hist->count * percentile / 100);
+  target = target < 1 ? 1 : target;
+  long seen = 0;
+  int idx = 0;
+  while (idx < UTHREAD_HIST_BUCKETS - 1 && seen + hist->buckets[idx] < target)
+    {
+      seen += hist->buckets[idx];
+      idx++;
+    }
+  unsigned long upper = idx;
+  if (idx >= (1 << UTHREAD_HIST_SUB_BITS))
+    {
+      int shift = (idx >> UTHREAD_HIST_SUB_BITS) - 1;
+      unsigned long sub = idx & ((1 << UTHREAD_HIST_SUB_BITS) - 1);
+      upper = (((1ul << UTHREAD_HIST_SUB_BITS) + sub + 1) << shift) - 1;
+    }
+  return upper < (unsigned long) hist->max ? (long) upper : hist->max;
+}
+
+/**
+ * @brief Copies up to max of the newest events of the scheduler trace to events, oldest first.
+ *
+ * @return On success, return the number of events copied. On failure, return -1.
+*/
+int uthread_trace_read (uthread_trace_event_t *events, int max)
+{
+  real_block ();
+  if (trace_ring == nullptr)
+    {
+      handle_err ("trace is off", LIB);
+      real_unblock ();
+      return -1;
+    }
+  int n = trace_copy (events, max);
+  real_unblock ();
+  return n;
+}
+
+/* names of the trace events, by UTHREAD_TRACE_* */
+const char *trace_names[] = {"spawn", "switch", "block", "resume", "sleep",
+                             "terminate", "idle"};
+
+/**
+ * @brief Writes the events of the scheduler trace to the file path in the Chrome trace_event JSON format.
+ *
+ * @return On success, return the number of events written. On failure, return -1.
+*/
+int uthread_trace_dump (const char *path)
+{
+  if (trace_ring == nullptr)
+    {
+      handle_err ("trace is off", LIB);
+      return -1;
+    }
+  std::vector<uthread_trace_event_t> events (trace_mask + 1);
+  int n = uthread_trace_read (events.data (), (int) events.size ());
+  FILE *f = fopen (path, "w");
+  if (f == nullptr)
+    {
+      handle_err ("could not open the trace file", LIB);
+      return -1;
+    }
+
+  // a run is a slice from the switch to a thread to the next switch or
+  // idle period of the same worker
+  long base = n > 0 ? events[0].ts_nsecs : 0;
+  std::vector<int> running (num_workers, -1);
+  std::vector<long> since (num_workers, 0);
+  const char *sep = "";
+  fprintf (f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for (int w = 0; w < num_workers; w++)
+    {
+      fprintf (f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+                  "\"args\":{\"name\":\"worker %d\"}}", sep, w, w);
+      sep = ",\n";
+    }
+  for (int i = 0; n > 0 && i <= n; i++)
+    {
+      // past the last event, the slices still open end with it
+      bool end = i == n;
+      const uthread_trace_event_t *e = &events[end ? n - 1 : i];
+      for (int w = 0; w < num_workers; w++)
+        {
+          bool closes = end || (e->worker == w && (e->type == UTHREAD_TRACE_SWITCH
+                                                   || e->type == UTHREAD_TRACE_IDLE));
+          if (closes && running[w] != -1)
+            {
+              fprintf (f, "%s{\"name\":\"thread %d\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+                          "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"tid\":%d}}", sep,
+                       running[w], w, (since[w] - base) / 1000.0,
+                       (e->ts_nsecs - since[w]) / 1000.0, running[w]);
+              running[w] = -1;
+            }
+        }
+      if (end)
+        {
+          break;
+        }
+      if (e->type == UTHREAD_TRACE_SWITCH)
+        {
+          running[e->worker] = e->tid;
+          since[e->worker] = e->ts_nsecs;
+        }
+      else
+        {
+          fprintf (f, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,"
+                      "\"ts\":%.3f,\"args\":{\"tid\":%d,\"arg\":%d}}", sep,
+                   trace_names[e->type], e->worker, (e->ts_nsecs - base) / 1000.0,
+                   e->tid, e->arg);
+        }
+    }
+  fprintf (f, "\n]}\n");
+  if (fclose (f) != 0)
+    {
+      handle_err ("could not write the trace file", LIB);
+      return -1;
+    }
+  return n;
+}
+
+/**
+ * @brief Creates a key of thread-specific data, and stores it in key.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_key_create (uthread_key_t *key, void (*destructor) (void *))
+{
+  real_block ();
+  if (keys_created == UTHREAD_KEYS_MAX)
+    {
+      handle_err ("you've reached max num of keys", LIB);
+      real_unblock ();
+      return -1;
+    }
+  key_destructors[keys_created] = destructor;
+  *key = keys_created++;
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Sets the value of the RUNNING thread for key.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_setspecific (uthread_key_t key, const void *value)
+{
+  if (key < 0 || key >= keys_created)
+    {
+      handle_err ("invalid key", LIB);
+      return -1;
+    }
+  running_specific[key] = const_cast<void *> (value);
+  return 0;
+}
+
+/**
+ * @brief Returns the value of the RUNNING thread for key.
+ *
+ * @return the value, nullptr if the thread set none or key is not a valid key.
+*/
+void *uthread_getspecific (uthread_key_t key)
+{
+  if ((unsigned int) key >= UTHREAD_KEYS_MAX)
+    {
+      return nullptr;
+    }
+  return running_specific[key];
+}
+
+/* header in front of every arena block: the arena it was cut from, its
+ * size class, ARENA_LARGE for a block mapped on its own, and the ID of the
+ * thread of the arena */
+struct ArenaHeader {
+  Arena *owner;
+  int size_class;
+  int owner_tid;
+};
+
+/* a free block, linked in place of its data */
+struct ArenaFree {
+  ArenaFree *next;
+};
+
+/* a block mapped on its own, with its mapping length and the links in the
+ * list of such blocks of its arena */
+struct ArenaLarge {
+  ArenaLarge *next;
+  ArenaLarge *prev;
+  size_t length;
+  long pad;
+  ArenaHeader header;
+};
+
+/**
+ * allocator of a single thread. only its thread touches it, except for the
+ * list of blocks other threads freed, which they push onto without a lock
+ * and the thread takes over at once. it lives at the start of its first
+ * chunk, after the link every chunk starts with
+ */
+struct Arena {
+  /* newest chunk, the chunks are linked through their first word, and the
+   * part of the newest one blocks were not cut from yet */
+  char *chunks = nullptr;
+  char *bump = nullptr;
+  char *end = nullptr;
+  ArenaFree *free[ARENA_CLASSES] = {};
+  ArenaLarge *large = nullptr;
+  std::atomic<ArenaFree *> remote{nullptr};
+  /* ID of the thread of the arena */
+  int tid = -1;
+};
+
+/* @return the mapping of a new chunk, nullptr if there is no memory */
+char *arena_map (size_t length)
+{
+  void *m = mmap (nullptr, length, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return m == MAP_FAILED ? nullptr : (char *) m;
+}
+
+/* @return a new arena in a chunk of its own, nullptr if there is no memory */
+Arena *arena_create ()
+{
+  char *chunk = arena_map (ARENA_CHUNK);
+  if (chunk == nullptr)
+    {
+      return nullptr;
+    }
+  *(char **) chunk = nullptr;
+  Arena *a = new (chunk + ARENA_ALIGN) Arena ();
+  a->chunks = chunk;
+  a->bump = chunk + ARENA_ALIGN + (sizeof (Arena) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+  a->end = chunk + ARENA_CHUNK;
+  return a;
+}
+
+/**
+ * maps a new chunk to cut blocks from. the rest of the previous one is
+ * left unused. the chunk is linked before the arena points to it, so a
+ * thread terminated in between leaves a consistent list
+ * @return false if there is no memory
+ */
+bool arena_grow (Arena *a)
+{
+  char *chunk = arena_map (ARENA_CHUNK);
+  if (chunk == nullptr)
+    {
+      return false;
+    }
+  *(char **) chunk = a->chunks;
+  a->chunks = chunk;
+  a->bump = chunk + ARENA_ALIGN;
+  a->end = chunk + ARENA_CHUNK;
+  return true;
+}
+
+/* @return a block of size bytes mapped on its own */
+void *arena_alloc_large (Arena *a, size_t size)
+{
+  if (size > ((size_t) -1) / 2)
+    {
+      return nullptr;
+    }
+  size_t length = page_round (sizeof (ArenaLarge) + size);
+  ArenaLarge *l = (ArenaLarge *) arena_map (length);
+  if (l == nullptr)
+    {
+      return nullptr;
+    }
+  l->length = length;
+  l->header.owner = a;
+  l->header.size_class = ARENA_LARGE;
+  l->header.owner_tid = a->tid;
+  l->prev = nullptr;
+  l->next = a->large;
+  if (a->large != nullptr)
+    {
+      a->large->prev = l;
+    }
+  a->large = l;
+  return l + 1;
+}
+
+/* unmaps a block that was mapped on its own */
+void arena_free_large (Arena *a, ArenaHeader *h)
+{
+  ArenaLarge *l = (ArenaLarge *) ((char *) (h + 1) - sizeof (ArenaLarge));
+  if (l->prev != nullptr)
+    {
+      l->prev->next = l->next;
+    }
+  else
+    {
+      a->large = l->next;
+    }
+  if (l->next != nullptr)
+    {
+      l->next->prev = l->prev;
+    }
+  munmap (l, l->length);
+}
+
+/* moves the blocks other threads freed to the free lists of the arena */
+void arena_collect (Arena *a)
+{
+  ArenaFree *block = a->remote.exchange (nullptr, std::memory_order_acquire);
+  while (block != nullptr)
+    {
+      ArenaFree *next = block->next;
+      ArenaHeader *h = (ArenaHeader *) block - 1;
+      if (h->size_class == ARENA_LARGE)
+        {
+          arena_free_large (a, h);
+        }
+      else
+        {
+          block->next = a->free[h->size_class];
+          a->free[h->size_class] = block;
+        }
+      block = next;
+    }
+}
+
+/* unmaps all the memory of an arena, with the arena itself */
+void arena_release (Arena *a)
+{
+  ArenaLarge *l = a->large;
+  while (l != nullptr)
+    {
+      ArenaLarge *next = l->next;
+      munmap (l, l->length);
+      l = next;
+    }
+  char *chunk = a->chunks;
+  while (chunk != nullptr)
+    {
+      char *next = *(char **) chunk;
+      munmap (chunk, ARENA_CHUNK);
+      chunk = next;
+    }
+}
+
+/**
+ * @brief Allocates size bytes from the arena of the RUNNING thread.
+ *
+ * @return On success, return the block. On failure, return nullptr.
+*/
+void *uthread_malloc (size_t size)
+{
+  if (running_arena == nullptr)
+    {
+      handle_err ("the library is not initialized", LIB);
+      return nullptr;
+    }
+  Arena *a = *running_arena;
+  if (a == nullptr)
+    {
+      a = arena_create ();
+      if (a == nullptr)
+        {
+          return nullptr;
+        }
+      a->tid = running_thread_id;
+      *running_arena = a;
+    }
+  if (size > ((size_t) 1 << (ARENA_MIN_SHIFT + ARENA_CLASSES - 1)))
+    {
+      return arena_alloc_large (a, size);
+    }
+  int size_class = size <= (1 << ARENA_MIN_SHIFT) ? 0
+      : (int) (sizeof (long) * 8) - __builtin_clzl (size - 1) - ARENA_MIN_SHIFT;
+  if (a->free[size_class] == nullptr
+      && a->remote.load (std::memory_order_relaxed) != nullptr)
+    {
+      arena_collect (a);
+    }
+  ArenaFree *block = a->free[size_class];
+  if (block != nullptr)
+    {
+      a->free[size_class] = block->next;
+      return block;
+    }
+  size_t need = sizeof (ArenaHeader) + ((size_t) 1 << (ARENA_MIN_SHIFT + size_class));
+  if (a->bump + need > a->end && !arena_grow (a))
+    {
+      return nullptr;
+    }
+  ArenaHeader *h = (ArenaHeader *) a->bump;
+  h->owner = a;
+  h->size_class = size_class;
+  h->owner_tid = a->tid;
+  a->bump += need;
+  return h + 1;
+}
+
+/**
+ * @brief Releases a block of uthread_malloc.
+*/
+void uthread_free (void *ptr)
+{
+  if (ptr == nullptr)
+    {
+      return;
+    }
+  ArenaHeader *h = (ArenaHeader *) ptr - 1;
+  Arena *a = h->owner;
+  ArenaFree *block = (ArenaFree *) ptr;
+  if (running_arena != nullptr && *running_arena == a)
+    {
+      if (h->size_class == ARENA_LARGE)
+        {
+          arena_free_large (a, h);
+          return;
+        }
+      block->next = a->free[h->size_class];
+      a->free[h->size_class] = block;
+      return;
+    }
+  // a block of another thread, which may be running on another worker. it
+  // is pushed in a critical section, so that the thread can not be
+  // terminated and its arena unmapped in the middle of the push
+  int owner_tid = h->owner_tid;
+  real_block ();
+  Thread *owner = threads[owner_tid];
+  if (owner == nullptr || owner->arena != a)
+    {
+      // the thread was terminated since, and the block went with its arena
+      real_unblock ();
+      return;
+    }
+  ArenaFree *head = a->remote.load (std::memory_order_relaxed);
+  do
+    {
+      block->next = head;
+    }
+  while (!a->remote.compare_exchange_weak (head, block, std::memory_order_release,
+                                           std::memory_order_relaxed));
+  real_unblock ();
+}
+
+/**
+ * @brief Sets the priority of the thread with ID tid.
+ *
+ * Under the MLFQ policy the thread also moves back to the level of its new priority.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_priority (int tid, int priority)
+{
+  real_block ();
+  if (threads[tid] == nullptr)
+    {
+      handle_err ("no such tid in set_priority func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  if (priority < 0 || priority >= UTHREAD_PRIORITIES)
+    {
+      handle_err ("invalid priority", LIB);
+      real_unblock ();
+      return -1;
+    }
+  threads[tid]->priority = priority;
+  if (policy == UTHREAD_POLICY_MLFQ)
+    {
+      mlfq_reset (threads[tid]);
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Sets the tickets of the thread with ID tid, its share of the cpu under the stride policy.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_tickets (int tid, int tickets)
+{
+  real_block ();
+  if (threads[tid] == nullptr)
+    {
+      handle_err ("no such tid in set_tickets func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  if (tickets < 1 || tickets > UTHREAD_MAX_TICKETS)
+    {
+      handle_err ("invalid tickets", LIB);
+      real_unblock ();
+      return -1;
+    }
+  threads[tid]->tickets = tickets;
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Makes the thread with ID tid a periodic EDF thread, or moves it back to the policy given to
+ * uthread_init_attr if period is 0.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_edf (int tid, int period, int budget)
+{
+  real_block ();
+  if (threads[tid] == nullptr)
+    {
+      handle_err ("no such tid in set_edf func", LIB);
+      real_unblock ();
+      return -1;
+    }
+  if (period < 0 || (period > 0 && (budget <= 0 || budget > period)))
+    {
+      handle_err ("invalid edf period or budget", LIB);
+      real_unblock ();
+      return -1;
+    }
+  if (num_workers > 1)
+    {
+      handle_err ("edf needs a single worker", LIB);
+      real_unblock ();
+      return -1;
+    }
+
+  Thread *t = threads[tid];
+  if (t->ready)
+    {
+      remove_from_ready (tid);
+    }
+  if (t->edf_waiting)
+    {
+      t->edf_waiting = false;
+      wheel_remove (t);
+    }
+  if (t->edf_period > 0 && period == 0)
+    {
+      edf_unlink (t);
+    }
+  else if (t->edf_period == 0 && period > 0)
+    {
+      t->edf_next = edf_threads;
+      t->edf_pprev = &edf_threads;
+      if (edf_threads != nullptr)
+        {
+          edf_threads->edf_pprev = &t->edf_next;
+        }
+      edf_threads = t;
+    }
+  t->edf_period = period;
+  t->edf_budget = budget;
+  t->edf_left = budget;
+  t->edf_deadline = total_quantums + 1 + period;
+  t->edf_done = false;
+  if (policy == UTHREAD_POLICY_MLFQ)
+    {
+      t->level = t->priority;
+    }
+  if (t->runnable () && !t->running)
+    {
+      return_to_ready (tid);
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Ends the job of the RUNNING EDF thread for its current period, it waits for its next period.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_wait_period ()
+{
+  real_block ();
+  Thread *t = threads[running_thread_id];
+  if (t->edf_period == 0)
+    {
+      handle_err ("running thread is not an edf thread", LIB);
+      real_unblock ();
+      return -1;
+    }
+  t->edf_done = true;
+  edf_wait (t);
+  switch_threads ();
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Initializes a free mutex, like UTHREAD_MUTEX_INITIALIZER.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_init (uthread_mutex_t *mutex)
+{
+  if (mutex == nullptr)
+    {
+      handle_err ("mutex is null", LIB);
+      return -1;
+    }
+  mutex->owner = -1;
+  mutex->waiters.head = nullptr;
+  mutex->waiters.tail = nullptr;
+  return 0;
+}
+
+/**
+ * @brief Locks mutex, waiting while another thread holds it.
+ *
+ * It is an error to lock a mutex the calling thread already holds.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_lock (uthread_mutex_t *mutex)
+{
+  if (mutex == nullptr)
+    {
+      handle_err ("mutex is null", LIB);
+      return -1;
+    }
+  real_block ();
+  if (mutex->owner == running_thread_id)
+    {
+      handle_err ("mutex already held by the thread", LIB);
+      real_unblock ();
+      return -1;
+    }
+  int ret = 0;
+  if (mutex->owner == -1)
+    {
+      mutex->owner = running_thread_id;
+    }
+  else
+    {
+      // the unlocking thread hands the mutex over before waking this one
+      ret = park (&mutex->waiters);
+    }
+  real_unblock ();
+  return ret;
+}
+
+/**
+ * @brief Unlocks mutex, which the calling thread must hold.
+ *
+ * If threads wait on mutex it is handed directly to the first of them, which holds it by the time it runs again.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_unlock (uthread_mutex_t *mutex)
+{
+  if (mutex == nullptr)
+    {
+      handle_err ("mutex is null", LIB);
+      return -1;
+    }
+  real_block ();
+  if (mutex->owner != running_thread_id)
+    {
+      handle_err ("mutex not held by the thread", LIB);
+      real_unblock ();
+      return -1;
+    }
+  Thread *next = unpark_first (&mutex->waiters);
+  mutex->owner = next != nullptr ? next->get_id () : -1;
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Initializes a condition variable with no waiters, like UTHREAD_COND_INITIALIZER.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_init (uthread_cond_t *cond)
+{
+  if (cond == nullptr)
+    {
+      handle_err ("cond is null", LIB);
+      return -1;
+    }
+  cond->waiters.head = nullptr;
+  cond->waiters.tail = nullptr;
+  return 0;
+}
+
+/**
+ * @brief Unlocks mutex and waits on cond, in one step. mutex is held again when the function returns.
+ *
+ * The calling thread must hold mutex.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_wait (uthread_cond_t *cond, uthread_mutex_t *mutex)
+{
+  if (cond == nullptr || mutex == nullptr)
+    {
+      handle_err ("cond or mutex is null", LIB);
+      return -1;
+    }
+  real_block ();
+  if (mutex->owner != running_thread_id)
+    {
+      handle_err ("mutex not held by the thread", LIB);
+      real_unblock ();
+      return -1;
+    }
+  Thread *next = unpark_first (&mutex->waiters);
+  mutex->owner = next != nullptr ? next->get_id () : -1;
+  threads[running_thread_id]->cond_mutex = mutex;
+  if (park (&cond->waiters) == -1)
+    {
+      // no thread could run, so none took the mutex
+      threads[running_thread_id]->cond_mutex = nullptr;
+      mutex->owner = running_thread_id;
+      real_unblock ();
+      return -1;
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Wakes the first thread waiting on cond, if there is such. It then waits for its mutex.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_signal (uthread_cond_t *cond)
+{
+  if (cond == nullptr)
+    {
+      handle_err ("cond is null", LIB);
+      return -1;
+    }
+  real_block ();
+  Thread *t = (Thread *) cond->waiters.head;
+  if (t != nullptr)
+    {
+      wait_unlink (t);
+      cond_requeue (t);
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Wakes all the threads waiting on cond.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_broadcast (uthread_cond_t *cond)
+{
+  if (cond == nullptr)
+    {
+      handle_err ("cond is null", LIB);
+      return -1;
+    }
+  real_block ();
+  Thread *t;
+  while ((t = (Thread *) cond->waiters.head) != nullptr)
+    {
+      wait_unlink (t);
+      cond_requeue (t);
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Initializes a semaphore with the given non-negative value.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_init (uthread_sem_t *sem, int value)
+{
+  if (sem == nullptr || value < 0)
+    {
+      handle_err ("invalid semaphore", LIB);
+      return -1;
+    }
+  sem->value = value;
+  sem->waiters.head = nullptr;
+  sem->waiters.tail = nullptr;
+  return 0;
+}
+
+/**
+ * @brief Decrements sem, waiting while its value is 0.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_wait (uthread_sem_t *sem)
+{
+  if (sem == nullptr)
+    {
+      handle_err ("sem is null", LIB);
+      return -1;
+    }
+  real_block ();
+  int ret = 0;
+  if (sem->value > 0)
+    {
+      sem->value--;
+    }
+  else
+    {
+      // a post wakes this thread instead of incrementing the value
+      ret = park (&sem->waiters);
+    }
+  real_unblock ();
+  return ret;
+}
+
+/**
+ * @brief Increments sem. If threads wait on sem, the first of them is woken and takes the increment instead.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_post (uthread_sem_t *sem)
+{
+  if (sem == nullptr)
+    {
+      handle_err ("sem is null", LIB);
+      return -1;
+    }
+  real_block ();
+  if (unpark_first (&sem->waiters) == nullptr)
+    {
+      sem->value++;
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Creates a channel of elements of elem_size bytes.
+ *
+ * capacity is the number of elements the channel buffers. With capacity 0 a send waits for a receive and the other
+ * way around. With UTHREAD_CHAN_UNBOUNDED a send never waits.
+ *
+ * @return On success, return the channel. On failure, return NULL.
+*/
+uthread_chan *uthread_chan_create (int elem_size, int capacity)
+{
+  if (elem_size <= 0 || (capacity < 0 && capacity != UTHREAD_CHAN_UNBOUNDED))
+    {
+      handle_err ("invalid channel size", LIB);
+      return nullptr;
+    }
+  real_block ();
+  uthread_chan *chan = new uthread_chan ();
+  chan->elem_size = elem_size;
+  chan->capacity = capacity;
+  chan->buf_slots = capacity > 0 ? capacity : 1;
+  chan->buf = new char[(size_t) chan->buf_slots * elem_size];
+  real_unblock ();
+  return chan;
+}
+
+/**
+ * @brief Destroys a channel no thread waits on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_destroy (uthread_chan *chan)
+{
+  if (chan == nullptr)
+    {
+      handle_err ("channel is null", LIB);
+      return -1;
+    }
+  real_block ();
+  if (chan->sendq.head != nullptr || chan->recvq.head != nullptr)
+    {
+      handle_err ("threads wait on the destroyed channel", LIB);
+      real_unblock ();
+      return -1;
+    }
+  delete[] chan->buf;
+  delete chan;
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Sends a copy of the element at elem, waiting while the channel is full.
+ *
+ * It is an error to send to a closed channel, including one that was closed while the thread waited.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_send (uthread_chan *chan, const void *elem)
+{
+  if (chan == nullptr || elem == nullptr)
+    {
+      handle_err ("channel or element is null", LIB);
+      return -1;
+    }
+  real_block ();
+  if (chan->closed)
+    {
+      handle_err ("send on a closed channel", LIB);
+      real_unblock ();
+      return -1;
+    }
+  if (chan_can_send (chan))
+    {
+      chan_send_now (chan, elem);
+      real_unblock ();
+      return 0;
+    }
+  if (!may_park ())
+    {
+      real_unblock ();
+      return -1;
+    }
+  ChanWaiter w;
+  w.chan = chan;
+  w.send = true;
+  w.elem = (void *) elem;
+  chan_wait (&w, 1);
+  if (!w.ok)
+    {
+      handle_err ("channel closed while sending", LIB);
+      real_unblock ();
+      return -1;
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Receives an element into elem, waiting while the channel is empty.
+ *
+ * Once a closed channel has no more elements, the function stores zeros at elem and returns immediately.
+ *
+ * @return 1 if an element was received, 0 if the channel is closed and empty, -1 on failure.
+*/
+int uthread_chan_recv (uthread_chan *chan, void *elem)
+{
+  if (chan == nullptr || elem == nullptr)
+    {
+      handle_err ("channel or element is null", LIB);
+      return -1;
+    }
+  real_block ();
+  if (chan_can_recv (chan))
+    {
+      int ret = chan_recv_now (chan, elem);
+      real_unblock ();
+      return ret;
+    }
+  if (!may_park ())
+    {
+      real_unblock ();
+      return -1;
+    }
+  ChanWaiter w;
+  w.chan = chan;
+  w.send = false;
+  w.elem = elem;
+  chan_wait (&w, 1);
+  real_unblock ();
+  return w.ok ? 1 : 0;
+}
+
+/**
+ * @brief Closes a channel. Waiting receivers get 0 from uthread_chan_recv, waiting senders fail.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_close (uthread_chan *chan)
+{
+  if (chan == nullptr)
+    {
+      handle_err ("channel is null", LIB);
+      return -1;
+    }
+  real_block ();
+  if (chan->closed)
+    {
+      handle_err ("channel already closed", LIB);
+      real_unblock ();
+      return -1;
+    }
+  chan->closed = true;
+  while (chan->recvq.head != nullptr)
+    {
+      memset (chan->recvq.head->elem, 0, chan->elem_size);
+      chan_complete (chan->recvq.head, false);
+    }
+  while (chan->sendq.head != nullptr)
+    {
+      chan_complete (chan->sendq.head, false);
+    }
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * @brief Performs one of the n operations in cases, waiting until one of them can proceed.
+ *
+ * If several cases can proceed one of them is chosen, starting from a different case each call so that no case is
+ * starved. If nonblock is nonzero and no case can proceed, the function returns n instead of waiting.
+ * A send case of a closed channel is an error.
+ *
+ * @return The index of the case that was performed, n (see nonblock), or -1 on failure.
+*/
+int uthread_chan_select (uthread_chan_case *cases, int n, int nonblock)
+{
+  if (cases == nullptr || n <= 0)
+    {
+      handle_err ("no select cases", LIB);
+      return -1;
+    }
+  for (int i = 0; i < n; i++)
+    {
+      if (cases[i].chan == nullptr || cases[i].elem == nullptr
+          || (cases[i].dir != UTHREAD_CHAN_SEND && cases[i].dir != UTHREAD_CHAN_RECV))
+        {
+          handle_err ("invalid select case", LIB);
+          return -1;
+        }
+    }
+  real_block ();
+  int start = (int) (select_rotor++ % (unsigned int) n);
+  for (int k = 0; k < n; k++)
+    {
+      int i = (start + k) % n;
+      uthread_chan *chan = cases[i].chan;
+      if (cases[i].dir == UTHREAD_CHAN_SEND && chan->closed)
+        {
+          handle_err ("send on a closed channel", LIB);
+          real_unblock ();
+          return -1;
+        }
+      if (cases[i].dir == UTHREAD_CHAN_SEND && chan_can_send (chan))
+        {
+          chan_send_now (chan, cases[i].elem);
+          real_unblock ();
+          return i;
+        }
+      if (cases[i].dir == UTHREAD_CHAN_RECV && chan_can_recv (chan))
+        {
+          cases[i].ok = chan_recv_now (chan, cases[i].elem);
+          real_unblock ();
+          return i;
+        }
+    }
+  if (nonblock)
+    {
+      real_unblock ();
+      return n;
+    }
+  if (!may_park ())
+    {
+      real_unblock ();
+      return -1;
+    }
+  // the waiters of a small select are on the stack, so that nothing leaks
+  // if the thread is terminated while it waits
+  ChanWaiter on_stack[SELECT_STACK_CASES];
+  std::vector<ChanWaiter> on_heap (n > SELECT_STACK_CASES ? n : 0);
+  ChanWaiter *waiters = n > SELECT_STACK_CASES ? on_heap.data () : on_stack;
+  for (int i = 0; i < n; i++)
+    {
+      waiters[i].chan = cases[i].chan;
+      waiters[i].send = cases[i].dir == UTHREAD_CHAN_SEND;
+      waiters[i].elem = cases[i].elem;
+    }
+  int i = chan_wait (waiters, n);
+  if (waiters[i].send && !waiters[i].ok)
+    {
+      handle_err ("channel closed while sending", LIB);
+      real_unblock ();
+      return -1;
+    }
+  if (!waiters[i].send)
+    {
+      cases[i].ok = waiters[i].ok;
+    }
+  real_unblock ();
+  return i;
+}
+
+/**
+ * @brief Reads up to count bytes from fd into buf, like read(2), without blocking the other threads.
+ *
+ * fd is made non-blocking. While it has nothing to read the calling thread waits, and other threads run. When no
+ * thread can run the process sleeps until one of the fds threads wait on is ready.
+ *
+ * @return As read(2): the number of bytes read, 0 at end of file, or -1 with errno set.
+*/
+ssize_t uthread_read (int fd, void *buf, size_t count)
+{
+  if (set_nonblocking (fd) == -1)
+    {
+      return -1;
+    }
+  // the call is retried in the critical section, so that the fd can not
+  // become ready between a failed call and the wait
+  real_block ();
+  ssize_t n;
+  while (would_block (n = read (fd, buf, count)))
+    {
+      io_wait (fd, false);
+    }
+  int saved_errno = worker_errno ();
+  real_unblock ();
+  worker_errno () = saved_errno;
+  return n;
+}
+
+/**
+ * @brief Writes up to count bytes from buf to fd, like write(2), without blocking the other threads.
+ *
+ * fd is made non-blocking. While it can not be written the calling thread waits, as in uthread_read.
+ *
+ * @return As write(2): the number of bytes written, or -1 with errno set.
+*/
+ssize_t uthread_write (int fd, const void *buf, size_t count)
+{
+  if (set_nonblocking (fd) == -1)
+    {
+      return -1;
+    }
+  // the call is retried in the critical section, so that the fd can not
+  // become ready between a failed call and the wait
+  real_block ();
+  ssize_t n;
+  while (would_block (n = write (fd, buf, count)))
+    {
+      io_wait (fd, true);
+    }
+  int saved_errno = worker_errno ();
+  real_unblock ();
+  worker_errno () = saved_errno;
+  return n;
+}
+
+/**
+ * @brief Accepts a connection on the listening socket fd, like accept(2), without blocking the other threads.
+ *
+ * fd is made non-blocking. While no connection is pending the calling thread waits, as in uthread_read.
+ *
+ * @return As accept(2): the fd of the accepted socket, or -1 with errno set.
+*/
+int uthread_accept (int fd, struct sockaddr *addr, socklen_t *addrlen)
+{
+  if (set_nonblocking (fd) == -1)
+    {
+      return -1;
+    }
+  // the call is retried in the critical section, so that the fd can not
+  // become ready between a failed call and the wait
+  real_block ();
+  int conn;
+  while (would_block (conn = accept (fd, addr, addrlen)))
+    {
+      io_wait (fd, false);
+    }
+  int saved_errno = worker_errno ();
+  io_forget (conn);
+  real_unblock ();
+  worker_errno () = saved_errno;
+  return conn;
+}
+
+/**
+ * @brief Closes fd, like close(2), and stops watching it for the threads that wait for I/O.
+ *
+ * Threads waiting to read or write fd are woken, and their call fails with EBADF.
+ *
+ * @return As close(2): 0, or -1 with errno set.
+*/
+int uthread_close (int fd)
+{
+  real_block ();
+  if (fd >= 0 && fd < (int) io_fds.size () && io_fds[fd] != nullptr
+      && io_fds[fd]->registered)
+    {
+      // a dup would keep the file in the epoll set past the close
+      epoll_ctl (epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+      io_fds[fd]->registered = false;
+    }
+  int ret = close (fd);
+  int saved_errno = worker_errno ();
+  // the threads waiting on fd try again, and fail with EBADF
+  if (ret == 0 && fd < (int) io_fds.size () && io_fds[fd] != nullptr)
+    {
+      while (unpark_first (&io_fds[fd]->readers) != nullptr);
+      while (unpark_first (&io_fds[fd]->writers) != nullptr);
+    }
+  real_unblock ();
+  worker_errno () = saved_errno;
+  return ret;
+}
+
+/* task of a pool, which is also the future of its result */
+struct uthread_future {
+  void *(*fn) (void *);
+  void *arg;
+  void *result;
+  bool done;
+  /* the thread waiting in uthread_future_get */
+  uthread_wait_queue waiters;
+  /* next task in the queue of the pool */
+  uthread_future *next;
+};
+
+struct uthread_pool {
+  /* ID's of the worker threads */
+  std::vector<int> workers;
+  /* FIFO of the tasks no worker took yet */
+  uthread_future *head;
+  uthread_future *tail;
+  /* workers waiting for a task */
+  uthread_wait_queue idle;
+  /* workers that still take tasks. a worker stops when it can not wait for
+   * one, because no other thread could ever submit it */
+  int live_workers;
+  bool closing;
+};
+
+/**
+ * start routine of the worker threads of a pool. takes the tasks in the
+ * order they were submitted and waits while there are none, until the
+ * pool is destroyed and its queue is empty
+ */
+void *pool_worker (void *arg)
+{
+  uthread_pool *pool = (uthread_pool *) arg;
+  real_block ();
+  for (;;)
+    {
+      while (pool->head == nullptr && !pool->closing)
+        {
+          if (park (&pool->idle) == -1)
+            {
+              pool->live_workers--;
+              handle_err ("a pool worker stopped, no thread can submit a task", LIB);
+              real_unblock ();
+              return nullptr;
+            }
+        }
+      uthread_future *task = pool->head;
+      if (task == nullptr)
+        {
+          break;
+        }
+      pool->head = task->next;
+      if (pool->head == nullptr)
+        {
+          pool->tail = nullptr;
+        }
+      real_unblock ();
+      void *result = task->fn (task->arg);
+      real_block ();
+      task->result = result;
+      task->done = true;
+      unpark_first (&task->waiters);
+    }
+  real_unblock ();
+  return nullptr;
+}
+
+/**
+ * @brief Creates a pool of the given number of worker threads, that run the tasks submitted to it.
  *
- * @return On success, return 0. On failure, return -1.
+ * @return On success, return the pool. On failure, return NULL.
 */
-int uthread_init (int quantum_usecs)
+uthread_pool *uthread_pool_create (int workers)
 {
-
-  sigemptyset (&masked);
-  sigaddset (&masked, SIGVTALRM);
+  if (workers <= 0)
+    {
+      handle_err ("invalid number of pool workers", LIB);
+      return nullptr;
+    }
   real_block ();
-
-  // fill the min heap with id's
-  for (int i = 1; i < MAX_THREAD_NUM; ++i)
+  uthread_pool *pool = new uthread_pool ();
+  for (int i = 0; i < workers; i++)
     {
-      available_ids.push (i);
+      int tid = spawn_thread (nullptr, pool_worker, pool, 0);
+      if (tid == -1)
+        {
+          real_unblock ();
+          uthread_pool_destroy (pool);
+          return nullptr;
+        }
+      pool->workers.push_back (tid);
+      pool->live_workers++;
     }
-  // check quantum number
-  if (quantum_usecs <= 0)
+  real_unblock ();
+  return pool;
+}
+
+/**
+ * @brief Destroys a pool once the tasks submitted to it have run.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_pool_destroy (uthread_pool *pool)
+{
+  if (pool == nullptr)
     {
-      handle_err ("invalid quantum_usecs", LIB);
+      handle_err ("pool is null", LIB);
       return -1;
     }
-  quantum_val = quantum_usecs;
-
-  //set time
-  timer.it_value.tv_sec = quantum_val / 1000000;
-  timer.it_value.tv_usec = quantum_val % 1000000;
-  timer.it_interval.tv_sec = 0;
-  timer.it_interval.tv_usec = 0;
-
-  if (setitimer (ITIMER_VIRTUAL, &timer, nullptr))
+  real_block ();
+  for (int tid : pool->workers)
     {
-      handle_err ("err setitimer", SYS);
+      if (tid == running_thread_id)
+        {
+          handle_err ("a pool worker cannot destroy its pool", LIB);
+          real_unblock ();
+          return -1;
+        }
     }
-
-  sa.sa_handler = &scheduler;
-  if (sigaction (SIGVTALRM, &sa, nullptr) < 0)
+  pool->closing = true;
+  while (unpark_first (&pool->idle) != nullptr)
     {
-      handle_err ("sigaction err", SYS);
     }
-
-  threads[0] = new Thread (0);
-  running_thread_id = 0;
-  threads[0]->running = true;
-
-  sigsetjmp(env[0], 1);
-  (env[0]->__jmpbuf)[JB_SP] = (long) __builtin_frame_address (0);
-  (env[0]->__jmpbuf)[JB_PC] = (long) __builtin_return_address (0);
-  sigemptyset (&env[0]->__saved_mask);
-
-  threads[0]->inc_quantums ();
   real_unblock ();
+  for (int tid : pool->workers)
+    {
+      uthread_join (tid, nullptr);
+    }
+  delete pool;
   return 0;
 }
 
 /**
- * @brief Creates a new thread, whose entry point is the function entry_point with the signature
- * void entry_point(void).
- *
- * The thread is added to the end of the READY threads list.
- * The uthread_spawn function should fail if it would cause the number of concurrent threads to exceed the
- * limit (MAX_THREAD_NUM).
- * Each thread should be allocated with a stack of size STACK_SIZE bytes.
+ * @brief Submits the task fn(arg) to a pool.
  *
- * @return On success, return the ID of the created thread. On failure, return -1.
+ * @return On success, return the future of the task's result. On failure, return NULL.
 */
-int uthread_spawn (thread_entry_point entry_point)
+uthread_future *uthread_pool_submit (uthread_pool *pool, void *(*fn) (void *), void *arg)
 {
+  if (pool == nullptr || fn == nullptr)
+    {
+      handle_err ("pool or task is null", LIB);
+      return nullptr;
+    }
   real_block ();
-
-  if (entry_point == nullptr){
-      handle_err ("entry point is null", LIB);
-      real_unblock();
-      return -1;
-  }
-
-  int new_id = generate_id ();
-  if (new_id == -1)
+  if (pool->closing)
     {
+      handle_err ("the pool is destroyed", LIB);
       real_unblock ();
-      return -1;
+      return nullptr;
     }
-  stack[new_id] = new char[STACK_SIZE];
-  threads[new_id] = new Thread (new_id);
-
-  address_t sp, pc;
-  sp = (address_t) stack[new_id] + STACK_SIZE - sizeof (address_t);
-  pc = (address_t) entry_point;
-  sigsetjmp(env[new_id], 1);
-  (env[new_id]->__jmpbuf)[JB_SP] = (long) translate_address (sp);
-  (env[new_id]->__jmpbuf)[JB_PC] = (long) translate_address (pc);
-  sigemptyset (&env[new_id]->__saved_mask);
-
-  ready_deque.push_back (new_id);
-  threads[new_id]->ready = true;
+  if (pool->live_workers == 0)
+    {
+      handle_err ("the pool has no workers left", LIB);
+      real_unblock ();
+      return nullptr;
+    }
+  uthread_future *task = new uthread_future ();
+  task->fn = fn;
+  task->arg = arg;
+  if (pool->tail != nullptr)
+    {
+      pool->tail->next = task;
+    }
+  else
+    {
+      pool->head = task;
+    }
+  pool->tail = task;
+  unpark_first (&pool->idle);
   real_unblock ();
-  return new_id;
+  return task;
 }
 
 /**
- * @brief Terminates the thread with ID tid and deletes it from all relevant control structures.
- *
- * All the resources allocated by the library for this thread should be released. If no thread with ID tid exists it
- * is considered an error. Terminating the main thread (tid == 0) will result in the termination of the entire
- * process using exit(0) (after releasing the assigned library memory).
+ * @brief Waits until the task of future has run, stores its result in *ret if ret is not NULL, and frees future.
  *
- * @return The function returns 0 if the thread was successfully terminated and -1 otherwise. If a thread terminates
- * itself or the main thread is terminated, the function does not return.
+ * @return On success, return 0. On failure, return -1.
 */
-int uthread_terminate (int tid)
+int uthread_future_get (uthread_future *future, void **ret)
 {
+  if (future == nullptr)
+    {
+      handle_err ("future is null", LIB);
+      return -1;
+    }
   real_block ();
-  if (tid == 0)
+  if (!future->done)
     {
-      free_memory ();
-      real_unblock ();
-      exit (0);
+      if (future->waiters.head != nullptr)
+        {
+          handle_err ("another thread waits on the future", LIB);
+          real_unblock ();
+          return -1;
+        }
+      if (park (&future->waiters) == -1)
+        {
+          real_unblock ();
+          return -1;
+        }
     }
-    else if (tid >= MAX_THREAD_NUM || tid < 0 || threads[tid] == nullptr)
+  if (ret != nullptr)
     {
-      handle_err ("no such tid in terminate func", LIB);
-      real_unblock ();
-      return -1;
+      *ret = future->result;
     }
-  else if (tid == running_thread_id)
+  delete future;
+  real_unblock ();
+  return 0;
+}
+
+/**
+ * a stackless task is about to run again after the channel operation it
+ * waited on was completed: stores its result where the task wants it, and
+ * frees the waiter
+ */
+void co_chan_done (Thread *t)
+{
+  ChanWaiter *w = (ChanWaiter *) t->chan_copy;
+  if (w->send && !w->ok)
     {
+      handle_err ("channel closed while sending", LIB);
+    }
+  *t->co_ret = w->send ? (w->ok ? 0 : -1) : (w->ok ? 1 : 0);
+  delete[] t->chan_copy;
+  t->chan_copy = nullptr;
+  t->co_ret = nullptr;
+}
 
-      terminated_switch ();
-      //threads[tid]->block ();
-//      scheduler (0);
-//      delete_thread (tid);
+/**
+ * loop of the runner, the context stackless tasks run on. it resumes the
+ * running task until the task suspends, and then makes the scheduling
+ * decision, as the task would have made it in the function it waited in.
+ * a task that is done is deleted like a thread that terminated itself.
+ * the runner is only switched away from in between tasks, so that the
+ * next task it resumes may reuse its whole stack
+ */
+void coro_start ()
+{
+  if (stats_on)
+    {
+      stats_switch_in ();
     }
-  else if (!threads[tid]->is_blocked())
+  for (;;)
     {
-      if (threads[tid]->get_sleep() <= 0){
-        remove_from_ready (tid);
-      }
-      delete_thread (tid);
+      Thread *t = threads[running_thread_id];
+      if (t->co_ret != nullptr)
+        {
+          co_chan_done (t);
+        }
+      stackless_running = true;
+      real_unblock ();
+      bool done = t->co_resume (t->co_frame) != 0;
+      stackless_running = false;
+      if (done && keys_created > 0)
+        {
+          destroy_specific (t->get_id ());
+        }
+      real_block ();
+      if (done)
+        {
+          destroy_frame (t);
+          terminated_switch ();
+        }
+      else
+        {
+          switch_threads ();
+        }
     }
-  else if (threads[tid]->is_blocked ())
+}
+
+/**
+ * @return whether the caller is the code of a stackless task, reports an
+ * error otherwise. the caller is inside a critical section
+ */
+bool in_stackless_task ()
+{
+  if (!stackless_running)
     {
-      delete_thread (tid);
+      handle_err ("co_await outside of a stackless task", LIB);
+      return false;
     }
-  real_unblock ();
-  return 0;
+  return true;
 }
 
 /**
- * @brief Blocks the thread with ID tid. The thread may be resumed later using uthread_resume.
+ * @brief Creates a stackless task that runs the coroutine frame with resume, and deletes it with destroy.
  *
- * If no thread with ID tid exists it is considered as an error. In addition, it is an error to try blocking the
- * main thread (tid == 0). If a thread blocks itself, a scheduling decision should be made. Blocking a thread in
- * BLOCKED state has no effect and is not considered an error.
- *
- * @return On success, return 0. On failure, return -1.
+ * @return On success, return the ID of the task. On failure, return -1.
 */
-int uthread_block (int tid)
+int uthread_co_spawn (void *frame, int (*resume) (void *), void (*destroy) (void *))
 {
-  real_block ();
-
-  if (tid >= MAX_THREAD_NUM || tid < 0 || threads[tid] == nullptr)
+  if (frame == nullptr || resume == nullptr || destroy == nullptr)
     {
-      handle_err ("no such tid in block func", LIB);
-      real_unblock ();
+      handle_err ("frame or function is null", LIB);
       return -1;
     }
-  else if (tid == 0)
+  real_block ();
+  if (num_workers > 1 || shared_stack != nullptr)
     {
-      handle_err ("trying block the main thread", LIB);
+      handle_err ("stackless tasks need a single worker and a stack per thread", LIB);
       real_unblock ();
       return -1;
     }
-  else if (tid == running_thread_id)
+  if (coro_runner.stack == nullptr)
     {
-      threads[tid]->block ();
-      scheduler (0);
+      coro_runner.stack = stack_alloc ();
+      if (coro_runner.stack == nullptr)
+        {
+          real_unblock ();
+          return -1;
+        }
+      make_context (&coro_runner, coro_runner.stack, stack_size, &coro_start);
     }
-  else if (!threads[tid]->is_blocked ())
+  int new_id = generate_id ();
+  if (new_id == -1)
     {
-      threads[tid]->block ();
-      // remove from ready queue
-      if (threads[tid]->get_sleep() <= 0){
-        remove_from_ready (tid);
-      }
-
+      real_unblock ();
+      return -1;
     }
+  Thread *t = threads.create (new_id);
+  t->stackless = true;
+  t->co_frame = frame;
+  t->co_resume = resume;
+  t->co_destroy = destroy;
+  t->born = total_quantums;
+  return_to_ready (new_id);
+  trace (UTHREAD_TRACE_SPAWN, new_id, running_thread_id);
   real_unblock ();
-  return 0;
+  return new_id;
 }
 
 /**
- * @brief Resumes a blocked thread with ID tid and moves it to the READY state.
- *
- * Resuming a thread in a RUNNING or READY state has no effect and is not considered as an error. If no thread with
- * ID tid exists it is considered an error.
+ * @brief Allocates a coroutine frame of size bytes, safely while the caller may be preempted.
  *
- * @return On success, return 0. On failure, return -1.
+ * @return On success, return the frame. On failure, return NULL.
 */
-int uthread_resume (int tid)
+void *uthread_co_frame_alloc (size_t size)
 {
   real_block ();
-
-  if (tid < 0 || tid >= MAX_THREAD_NUM || threads[tid] == nullptr
-      || (stack[tid] == nullptr && (tid != 0)))
+  void *frame = malloc (size);
+  real_unblock ();
+  if (frame == nullptr)
     {
-      handle_err ("no such tid in resume func", LIB);
-      real_unblock ();
-      return -1;
+      handle_err ("coroutine frame allocation failed", LIB);
     }
+  return frame;
+}
 
-  if (threads[tid]->get_sleep () <= 0 &&
-      !threads[tid]->ready &&
-      !threads[tid]->running &&
-      threads[tid]->is_blocked ())
-    {
-      threads[tid]->unblock ();
-      ready_deque.push_back (tid);
-    }
-  else if (threads[tid]->get_sleep () > 0)
+/**
+ * @brief Frees a frame uthread_co_frame_alloc returned.
+*/
+void uthread_co_frame_free (void *frame)
+{
+  if (destroying_frame)
     {
-      threads[tid]->unblock ();
+      free (frame);
+      return;
     }
+  real_block ();
+  free (frame);
   real_unblock ();
-  return 0;
 }
 
 /**
- * @brief Blocks the RUNNING thread for num_quantums quantnums.
- *
- * Immediately after the RUNNING thread transitions to the BLOCKED state a scheduling decision should be made.
- * After the sleeping time is over, the thread should go back to the end of the READY threads list.
- * The number of quantnums refers to the number of times a new quantum starts, regardless of the reason. Specifically,
- * the quantum of the thread which has made the call to uthread_sleep isn’t counted.
- * It is considered an error if the main thread (tid==0) calls this function.
+ * @brief Puts the RUNNING stackless task to sleep for num_quantums quantums once it suspends.
  *
- * @return On success, return 0. On failure, return -1.
+ * @return 1 if the task is to suspend, 0 if it is not (num_quantums is not positive), -1 on failure.
 */
-int uthread_sleep (int num_quantums)
+int uthread_co_sleep (int num_quantums)
 {
   real_block ();
+  if (!in_stackless_task ())
+    {
+      real_unblock ();
+      return -1;
+    }
+  if (num_quantums <= 0)
+    {
+      real_unblock ();
+      return 0;
+    }
+  sleep_running (num_quantums);
+  real_unblock ();
+  return 1;
+}
 
-  if (running_thread_id == 0)
+/**
+ * sends or receives like uthread_chan_send and uthread_chan_recv for the
+ * running stackless task. an operation that would wait is left to a peer,
+ * with a waiter on the heap, as the task has no stack to keep it on
+ * @return as uthread_co_chan_send
+ */
+int co_chan (uthread_chan *chan, bool send, void *elem, int *ret)
+{
+  if (chan == nullptr || elem == nullptr || ret == nullptr)
+    {
+      handle_err ("channel, element or result is null", LIB);
+      return -1;
+    }
+  real_block ();
+  if (!in_stackless_task ())
     {
-      handle_err ("main thread can't sleep", LIB);
       real_unblock ();
       return -1;
     }
-  else if (num_quantums > 0)
+  if (send && chan->closed)
     {
-//      sleep_or_blocked_switch ();
-      threads[running_thread_id]->sleep = num_quantums;
-      scheduler (0);
+      handle_err ("send on a closed channel", LIB);
+      real_unblock ();
+      return -1;
+    }
+  if (send ? chan_can_send (chan) : chan_can_recv (chan))
+    {
+      if (send)
+        {
+          chan_send_now (chan, elem);
+          *ret = 0;
+        }
+      else
+        {
+          *ret = chan_recv_now (chan, elem);
+        }
+      real_unblock ();
+      return 0;
+    }
+  if (!may_park ())
+    {
+      real_unblock ();
+      return -1;
     }
+  Thread *t = threads[running_thread_id];
+  t->chan_copy = new char[sizeof (ChanWaiter)];
+  ChanWaiter *w = (ChanWaiter *) t->chan_copy;
+  w->chan = chan;
+  w->send = send;
+  w->elem = elem;
+  chan_park (t, w, 1);
+  t->co_ret = ret;
   real_unblock ();
-  return 0;
+  return 1;
 }
 
 /**
- * @brief Returns the thread ID of the calling thread.
+ * @brief Sends elem to chan for the RUNNING stackless task, and stores what uthread_chan_send would return in *ret.
  *
- * @return The ID of the calling thread.
+ * @return 1 if the task is to suspend, 0 if *ret was stored at once, -1 on failure.
 */
-int uthread_get_tid ()
-{ return running_thread_id; }
+int uthread_co_chan_send (uthread_chan *chan, const void *elem, int *ret)
+{
+  return co_chan (chan, true, (void *) elem, ret);
+}
 
 /**
- * @brief Returns the total number of quantnums since the library was initialized, including the current quantum.
- *
- * Right after the call to uthread_init, the value should be 1.
- * Each time a new quantum starts, regardless of the reason, this number should be increased by 1.
+ * @brief Receives from chan into elem for the RUNNING stackless task, and stores what uthread_chan_recv would
+ * return in *ret.
  *
- * @return The total number of quantnums.
+ * @return 1 if the task is to suspend, 0 if *ret was stored at once, -1 on failure.
 */
-int uthread_get_total_quantums ()
-{ return total_quantums; }
+int uthread_co_chan_recv (uthread_chan *chan, void *elem, int *ret)
+{
+  return co_chan (chan, false, elem, ret);
+}
 
 /**
- * @brief Returns the number of quantnums the thread with ID tid was in RUNNING state.
- *
- * On the first time a thread runs, the function should return 1. Every additional quantum that the thread starts should
- * increase this value by 1 (so if the thread with ID tid is in RUNNING state when this function is called, include
- * also the current quantum). If no thread with ID tid exists it is considered an error.
+ * @brief Makes the RUNNING stackless task wait until fd can be written (write) or read, once it suspends.
  *
- * @return On success, return the number of quantnums of the thread with ID tid. On failure, return -1.
+ * @return 1 if the task is to suspend, 0 if fd is ready already, -1 on failure.
 */
-int uthread_get_quantums (int tid)
+int uthread_co_wait_fd (int fd, int write)
 {
   real_block ();
-
-  if (tid >= MAX_THREAD_NUM || tid < 0 || threads[tid] == nullptr)
+  if (!in_stackless_task ())
     {
-      handle_err ("no such tid in get_quantum func", LIB);
       real_unblock ();
       return -1;
     }
-  int num = threads[tid]->get_quantums ();
+  // checked in the critical section, so that the scheduler can not take
+  // the event of fd before the task waits for it
+  struct pollfd p = {fd, (short) (write ? POLLOUT : POLLIN), 0};
+  if (poll (&p, 1, 0) != 0)
+    {
+      real_unblock ();
+      return 0;
+    }
+  io_register (fd, write != 0);
   real_unblock ();
-  return num;
+  return 1;
 }
-
-
-
-
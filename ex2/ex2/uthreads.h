@@ -8,11 +8,147 @@
 #define _UTHREADS_H
 
 
-#define MAX_THREAD_NUM 100 /* maximal number of threads */
-#define STACK_SIZE 4096 /* stack size per thread (in bytes) */
+/*
+ * Build options:
+ * UTHREADS_FAST_SWITCH - (x86_64 only) switch threads with a hand written register swap instead of
+ *                        sigsetjmp/siglongjmp, and guard the library's critical sections with a flag that the
+ *                        SIGVTALRM handler checks instead of masking the signal with sigprocmask.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#if defined(__cplusplus) && __cplusplus >= 202002L
+#include <coroutine>
+#include <exception>
+#include <optional>
+#endif
+
+#define MAX_THREAD_NUM 100 /* default maximal number of threads */
+#define STACK_SIZE 65536 /* default stack size per thread (in bytes) */
 
 typedef void (*thread_entry_point)(void);
 
+#define UTHREAD_KEYS_MAX 32 /* number of thread-specific data keys */
+
+/* key of thread-specific data, created with uthread_key_create */
+typedef int uthread_key_t;
+
+#define UTHREAD_PRIORITIES 8 /* number of thread priorities, 0 is the highest */
+
+#define UTHREAD_POLICY_RR 0 /* round robin, priorities are ignored */
+#define UTHREAD_POLICY_MLFQ 1 /* multi-level feedback queue */
+#define UTHREAD_POLICY_STRIDE 2 /* stride scheduling, cpu shares proportional to tickets */
+
+#define UTHREAD_DEFAULT_TICKETS 100 /* tickets of a thread under the stride policy */
+#define UTHREAD_MAX_TICKETS 65536
+
+/* options for uthread_init_attr. fields left 0 take their default value */
+typedef struct uthread_attr {
+    int quantum_usecs; /* length of a quantum in micro-seconds, must be positive */
+    int stack_size; /* stack size per thread in bytes, rounded up to whole pages (default STACK_SIZE) */
+    int max_threads; /* maximal number of concurrent threads including the main one (default MAX_THREAD_NUM) */
+    int workers; /* number of kernel threads running the threads (default 1), more than 1 selects the M:N mode */
+    int tickless; /* nonzero selects the tickless mode, see uthread_init_attr */
+    int wall_clock; /* nonzero measures quantums in real time instead of cpu time, see uthread_init_attr */
+    int policy; /* scheduling policy, UTHREAD_POLICY_RR (default), _MLFQ or _STRIDE, see uthread_init_attr */
+    int stats; /* nonzero records run times, READY waits and switch costs, see uthread_stats */
+    int trace_events; /* size of the scheduler event trace ring, 0 (default) for no trace, see uthread_trace_read */
+    int shared_stack; /* nonzero runs the threads on one shared stack, see uthread_init_attr */
+    int quantum_min_usecs; /* lower bound of an adaptive quantum (default 1) */
+    int quantum_max_usecs; /* nonzero selects the adaptive quantum, up to this long, see uthread_init_attr */
+    int overhead_percent; /* share of an adaptive quantum a switch may cost, 1 to 99 (default 1) */
+} uthread_attr;
+
+/* FIFO of the threads waiting on a synchronization object, managed by the library */
+typedef struct uthread_wait_queue {
+    void *head;
+    void *tail;
+} uthread_wait_queue;
+
+/* mutex, holds the ID of its owner or -1 if it is free */
+typedef struct uthread_mutex_t {
+    int owner;
+    uthread_wait_queue waiters;
+} uthread_mutex_t;
+
+/* condition variable */
+typedef struct uthread_cond_t {
+    uthread_wait_queue waiters;
+} uthread_cond_t;
+
+/* counting semaphore */
+typedef struct uthread_sem_t {
+    int value;
+    uthread_wait_queue waiters;
+} uthread_sem_t;
+
+#define UTHREAD_MUTEX_INITIALIZER {-1, {0, 0}}
+#define UTHREAD_COND_INITIALIZER {{0, 0}}
+
+/* channel of fixed size elements, created with uthread_chan_create */
+typedef struct uthread_chan uthread_chan;
+
+/* task pool, created with uthread_pool_create, and the future of a task submitted to it */
+typedef struct uthread_pool uthread_pool;
+typedef struct uthread_future uthread_future;
+
+#define UTHREAD_CHAN_UNBOUNDED (-1) /* capacity of a channel whose buffer grows as needed */
+
+#define UTHREAD_CHAN_SEND 0
+#define UTHREAD_CHAN_RECV 1
+
+/* one case of uthread_chan_select */
+typedef struct uthread_chan_case {
+    uthread_chan *chan;
+    int dir; /* UTHREAD_CHAN_SEND or UTHREAD_CHAN_RECV */
+    void *elem; /* the element to send, or where to store the received one */
+    int ok; /* set for a receive that was selected: 1 if an element was received, 0 if chan was closed */
+} uthread_chan_case;
+
+#define UTHREAD_HIST_SUB_BITS 4 /* each power of 2 is split in 2^UTHREAD_HIST_SUB_BITS buckets */
+#define UTHREAD_HIST_BUCKETS ((64 - UTHREAD_HIST_SUB_BITS + 1) << UTHREAD_HIST_SUB_BITS)
+
+/* log-linear histogram of nanosecond values, exact below 2^UTHREAD_HIST_SUB_BITS and within 1/16 above */
+typedef struct uthread_hist_t {
+    long count;
+    long max;
+    long buckets[UTHREAD_HIST_BUCKETS];
+} uthread_hist_t;
+
+/* time statistics of the process, see uthread_stats */
+typedef struct uthread_stats_t {
+    long switches; /* switches to a thread, including a thread continuing after it was switched out */
+    uthread_hist_t ready_wait; /* nanoseconds from becoming READY to the switch to the thread */
+    uthread_hist_t switch_cost; /* nanoseconds from the end of a thread's run to the start of the next */
+    long switch_cost_avg_nsecs; /* moving average of the switch cost, which the adaptive quantum is tuned by */
+} uthread_stats_t;
+
+/* time statistics of a thread, see uthread_thread_stats */
+typedef struct uthread_thread_stats_t {
+    long run_nsecs; /* time in RUNNING state */
+    long ready_nsecs; /* time in READY state */
+    long switch_nsecs; /* time spent switching to this thread */
+    long switches; /* switches to this thread */
+    long quantum_usecs; /* quantum the thread gets when it is switched to, see uthread_attr.quantum_max_usecs */
+} uthread_thread_stats_t;
+
+#define UTHREAD_TRACE_SPAWN 0 /* tid was spawned by arg */
+#define UTHREAD_TRACE_SWITCH 1 /* tid starts running on worker, arg ran before it (-1 in M:N mode) */
+#define UTHREAD_TRACE_BLOCK 2 /* tid was blocked by arg */
+#define UTHREAD_TRACE_RESUME 3 /* tid was resumed by arg */
+#define UTHREAD_TRACE_SLEEP 4 /* tid went to sleep for arg quantums */
+#define UTHREAD_TRACE_TERMINATE 5 /* tid was terminated by arg */
+#define UTHREAD_TRACE_IDLE 6 /* no thread runs on worker, tid is -1 */
+
+/* one event of the scheduler trace */
+typedef struct uthread_trace_event_t {
+    long ts_nsecs; /* CLOCK_MONOTONIC time */
+    int type; /* UTHREAD_TRACE_* */
+    int worker; /* the kernel thread it happened on, 0 with a single worker */
+    int tid;
+    int arg;
+} uthread_trace_event_t;
+
 /* External interface */
 
 
@@ -28,19 +164,170 @@ typedef void (*thread_entry_point)(void);
 */
 int uthread_init(int quantum_usecs);
 
+/**
+ * @brief initializes the thread library with the options in attr, instead of uthread_init.
+ *
+ * uthread_init(q) is the same as calling this function with only attr->quantum_usecs = q set.
+ * Thread stacks are carved out of one mmap region, with an inaccessible guard page below each stack so that a
+ * stack overflow faults instead of corrupting memory. Stacks of terminated threads are reused by the next spawns.
+ * The region is reserved for max_threads stacks up front, but stack memory is only committed once a thread
+ * touches it, so a large max_threads costs address space rather than memory.
+ *
+ * With workers > 1 the threads are run by that many kernel threads (pthreads), the calling one included, so they
+ * can use more than one core. Each worker keeps its ready threads in its own deque and an idle worker steals from the
+ * others, so a thread may continue on a different kernel thread after any switch. Each worker is preempted by its own
+ * cpu time timer. A thread that is blocked or terminated while it runs on another worker stops at the end of its
+ * current quantum. The library must then be linked with -pthread.
+ *
+ * In tickless mode the quantum timer is periodic instead of being set again on every switch, and it only runs while
+ * some thread other than the running one is READY or sleeping. A thread that is switched to after a voluntary switch
+ * (uthread_yield, uthread_block, uthread_sleep, uthread_terminate) gets what is left of the current period.
+ *
+ * By default a quantum is quantum_usecs of the process's cpu time (ITIMER_VIRTUAL). In wall clock mode it is
+ * quantum_usecs of real time (ITIMER_REAL, and SIGALRM instead of SIGVTALRM), so sleeps last a known time even while
+ * the threads wait for other things than the cpu. In both modes, while no thread is READY (the others sleep, are
+ * blocked or wait on a synchronization object or I/O) the process waits in the kernel without using the cpu, and a
+ * quantum passes every quantum_usecs of real time until the next sleeping thread wakes up or an fd is ready.
+ *
+ * The MLFQ policy keeps a READY list per priority level and runs the first thread of the highest non empty level.
+ * A thread starts at the level of its priority. It moves a level down when it uses up its quantum, and a level back
+ * up towards its priority when it gives the cpu up before (uthread_yield, uthread_sleep, blocking or waiting). A
+ * thread that stays READY for 32 quantums moves a level up, past its priority if needed, so that none starves. The
+ * policy needs a single worker.
+ *
+ * The stride policy gives each thread a share of the quantums proportional to its tickets (uthread_set_tickets). It
+ * runs the READY thread with the lowest pass value, which grows by UTHREAD_MAX_TICKETS * 256 / tickets with every
+ * quantum the thread starts. A thread that becomes READY after it slept, blocked or waited has its pass value
+ * raised to that of the threads that kept running, so it does not get the quantums it missed back at once. The
+ * policy needs a single worker.
+ *
+ * With quantum_max_usecs set, each thread gets a quantum of its own between quantum_min_usecs and
+ * quantum_max_usecs, tuned after each of its runs; quantum_usecs is the quantum of a thread until its first run ends.
+ * A thread that is preempted gets the shortest quantum a switch costs at most overhead_percent of, by the moving
+ * average of the switch cost, so that a cpu bound thread keeps the others waiting as little as the target allows. A
+ * thread that mostly gives the cpu up before its quantum ends gets twice its average run, so that it is not cut
+ * short. The adaptive quantum turns the time statistics on, which report the quantum of each thread (see
+ * uthread_thread_stats), and needs a single worker and no tickless mode. Since the quantum timer of cpu time only
+ * fires on the kernel's ticks, quantums shorter than a tick need wall clock mode.
+ *
+ * With shared_stack set the spawned threads all run on one stack of stack_size bytes, and a switch to a thread
+ * that does not have it copies the used part of the stack out to a heap buffer of the thread that had it, and the
+ * part of the next thread back in. A thread that is not running then costs what its stack uses instead of a stack,
+ * so max_threads can be much larger, and a switch costs a copy of the stacks' used parts. The main thread keeps its
+ * own stack, and switching between it and the thread that has the shared stack copies nothing. A thread's stack
+ * variables move while it does not run: they must not be shared with other threads, and objects used by more than
+ * one thread (synchronization objects, channels) must not be on the stack of a spawned thread. The shared stack
+ * needs a single worker.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_attr(const uthread_attr *attr);
+
 /**
  * @brief Creates a new thread, whose entry point is the function entry_point with the signature
  * void entry_point(void).
  *
  * The thread is added to the end of the READY threads list.
  * The uthread_spawn function should fail if it would cause the number of concurrent threads to exceed the
- * limit (MAX_THREAD_NUM).
- * Each thread should be allocated with a stack of size STACK_SIZE bytes.
+ * limit (MAX_THREAD_NUM, or the max_threads given to uthread_init_attr).
+ * Each thread should be allocated with a stack of size STACK_SIZE bytes (or the stack_size given to
+ * uthread_init_attr).
  *
  * @return On success, return the ID of the created thread. On failure, return -1.
 */
 int uthread_spawn(thread_entry_point entry_point);
 
+/**
+ * @brief Creates a new thread like uthread_spawn, with the given priority.
+ *
+ * priority is between 0 (the highest) and UTHREAD_PRIORITIES - 1. uthread_spawn gives priority 0. Priorities only
+ * matter under the MLFQ policy.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_prio(thread_entry_point entry_point, int priority);
+
+/**
+ * @brief Creates a new joinable thread like uthread_spawn, that runs start_routine(arg).
+ *
+ * The value start_routine returns is kept for uthread_join. The stack of the thread is released as soon as it
+ * terminates, only its result and ID are kept until it is joined or detached, and the ID is not reused until then.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_arg(void *(*start_routine)(void *), void *arg);
+
+/**
+ * @brief Creates count threads like uthread_spawn, and stores their ID's in tids unless it is nullptr.
+ *
+ * The threads are added to the end of the READY threads list in order. The library is entered once for all of them,
+ * instead of once per thread. If the count threads would exceed the limit on concurrent threads none is created.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_spawn_n(thread_entry_point entry_point, int count, int *tids);
+
+/**
+ * @brief Waits until the joinable thread with ID tid terminates.
+ *
+ * The calling thread is not scheduled while it waits, and is resumed when the thread terminates. If ret is not
+ * nullptr, the value the start routine of the thread returned is stored in *ret, nullptr if the thread was
+ * terminated with uthread_terminate. A thread can be joined once, by one thread, and not by itself.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_join(int tid, void **ret);
+
+/**
+ * @brief Makes the joinable thread with ID tid not joinable, its result is dropped and its ID reused once it
+ * terminates.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_detach(int tid);
+
+/**
+ * @brief Sets the priority of the thread with ID tid, the main thread included.
+ *
+ * Under the MLFQ policy the thread also moves back to the level of its new priority.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_priority(int tid, int priority);
+
+/**
+ * @brief Sets the tickets of the thread with ID tid, the main thread included.
+ *
+ * tickets is between 1 and UTHREAD_MAX_TICKETS, threads start with UTHREAD_DEFAULT_TICKETS. Tickets only matter
+ * under the stride policy.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_tickets(int tid, int tickets);
+
+/**
+ * @brief Makes the thread with ID tid a periodic real-time thread of the earliest deadline first (EDF) class.
+ *
+ * Every period quantums the thread gets a budget of budget quantums, 0 < budget <= period, and its deadline is the
+ * end of the period. A READY EDF thread always runs before the other threads, the one with the nearest deadline
+ * first. Every quantum an EDF thread starts uses one quantum of its budget. A thread that uses up its budget before
+ * it calls uthread_wait_period is throttled: it does not run until its next period begins. A period that ends
+ * before the thread called uthread_wait_period is a deadline miss. The first period begins in the next quantum.
+ * A period of 0 moves the thread back to the policy given to uthread_init_attr. EDF threads need a single worker.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_edf(int tid, int period, int budget);
+
+/**
+ * @brief Ends the job of the RUNNING EDF thread for its current period.
+ *
+ * The thread does not run until its next period begins. It is an error if the RUNNING thread is not an EDF thread.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_wait_period();
+
 
 /**
  * @brief Terminates the thread with ID tid and deletes it from all relevant control structures.
@@ -77,6 +364,16 @@ int uthread_block(int tid);
 */
 int uthread_resume(int tid);
 
+/**
+ * @brief Resumes the count threads with the ID's in tids like uthread_resume.
+ *
+ * The library is entered once for all of them, instead of once per thread. If one of the ID's has no thread it is
+ * considered an error, and no thread is resumed.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_resume_n(const int *tids, int count);
+
 
 /**
  * @brief Blocks the RUNNING thread for num_quantums quantnums.
@@ -92,6 +389,17 @@ int uthread_resume(int tid);
 int uthread_sleep(int num_quantums);
 
 
+/**
+ * @brief Moves the RUNNING thread to the end of the READY threads list and makes a scheduling decision.
+ *
+ * A new quantum starts, as if the quantum of the calling thread had expired. If no other thread is READY the calling
+ * thread keeps running.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_yield();
+
+
 /**
  * @brief Returns the thread ID of the calling thread.
  *
@@ -122,5 +430,581 @@ int uthread_get_total_quantums();
 */
 int uthread_get_quantums(int tid);
 
+/**
+ * @brief Returns the number of periods of the EDF thread with ID tid that ended before the thread completed its job.
+ *
+ * A thread that is not an EDF thread keeps the misses it had as one. If no thread with ID tid exists it is
+ * considered an error.
+ *
+ * @return On success, return the number of deadline misses of the thread with ID tid. On failure, return -1.
+*/
+int uthread_get_deadline_misses(int tid);
+
+/**
+ * @brief Returns the share of the cpu the thread with ID tid received.
+ *
+ * The share is the number of quantums the thread was in RUNNING state, divided by the number of quantums since it
+ * was spawned (since uthread_init for the main thread). If no thread with ID tid exists it is considered an error.
+ *
+ * @return On success, return a share between 0 and 1. On failure, return -1.
+*/
+double uthread_get_share(int tid);
+
+/**
+ * @brief Copies the time statistics of the process to stats.
+ *
+ * The library records them when uthread_init_attr was called with attr->stats set, which costs two reads of the
+ * monotonic clock per switch and one per thread that becomes READY. They need a single worker. Time the process
+ * spends idle, waiting for a sleeping thread or for I/O, is not counted as switch cost.
+ *
+ * @return On success, return 0. On failure (statistics are off), return -1.
+*/
+int uthread_stats(uthread_stats_t *stats);
+
+/**
+ * @brief Copies the time statistics of the thread with ID tid to stats.
+ *
+ * The run time of the RUNNING thread includes its current run. It is an error if statistics are off or if no thread
+ * with ID tid exists.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_thread_stats(int tid, uthread_thread_stats_t *stats);
+
+/**
+ * @brief Returns the value below which the given percentile (0 to 100) of the values in hist fall.
+ *
+ * The value is the upper bound of the bucket the percentile falls in, capped at the largest value recorded.
+ *
+ * @return the value in nanoseconds, 0 if hist is empty.
+*/
+long uthread_hist_percentile(const uthread_hist_t *hist, double percentile);
+
+/**
+ * @brief Copies up to max of the newest events of the scheduler trace to events, oldest first.
+ *
+ * With attr->trace_events set, the library records every spawn, switch, block, resume, sleep, terminate and idle
+ * period in a ring of that many events (rounded up to a power of 2), allocated by uthread_init_attr. Recording does
+ * not allocate or lock, so it is done from the quantum signal handler as well, and the oldest events are overwritten
+ * once the ring is full. It is an error if the trace is off.
+ *
+ * @return On success, return the number of events copied. On failure, return -1.
+*/
+int uthread_trace_read(uthread_trace_event_t *events, int max);
+
+/**
+ * @brief Writes the events of the scheduler trace to the file path in the Chrome trace_event JSON format.
+ *
+ * Each run of a thread is a slice on the timeline of the worker it ran on, and the other events are instant events,
+ * so the file can be opened in chrome://tracing or Perfetto. It is an error if the trace is off or path can not be
+ * written.
+ *
+ * @return On success, return the number of events written. On failure, return -1.
+*/
+int uthread_trace_dump(const char *path);
+
+
+/**
+ * @brief Creates a key of thread-specific data, and stores it in key.
+ *
+ * Each thread has its own value for the key, nullptr until it calls uthread_setspecific. When a thread other than
+ * the main thread is terminated, uthread_terminate calls destructor, unless it is nullptr, with each non-null value
+ * of the thread, in the thread that called uthread_terminate and once the terminated thread no longer runs. A thread
+ * running on another worker is waited for until it stops. A thread terminating itself destroys its values before it
+ * stops, and a destructor that sets values again has them destroyed as well, for up to 4 rounds. A failed
+ * uthread_terminate leaves the values as they are. At most UTHREAD_KEYS_MAX keys can be created.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void *));
+
+/**
+ * @brief Sets the value of the RUNNING thread for key.
+ *
+ * @return On success, return 0. On failure (key was not created), return -1.
+*/
+int uthread_setspecific(uthread_key_t key, const void *value);
+
+/**
+ * @brief Returns the value of the RUNNING thread for key, a single load from the thread's control block.
+ *
+ * @return the value, nullptr if the thread set none or key is not a valid key.
+*/
+void *uthread_getspecific(uthread_key_t key);
+
+
+/**
+ * @brief Allocates size bytes, aligned to 16, from the arena of the RUNNING thread.
+ *
+ * Each thread has an arena of its own, mapped when it first allocates, so allocating and freeing its own blocks
+ * neither blocks the timer signal nor takes a lock, and a thread preempted inside them leaves no other thread's memory
+ * in an inconsistent state. The
+ * whole arena is released when the thread is terminated: its blocks, also the start routine's result of a joinable
+ * thread, must not be used after that.
+ *
+ * @return On success, return the block. On failure (out of memory), return nullptr.
+*/
+void *uthread_malloc(size_t size);
+
+/**
+ * @brief Releases a block of uthread_malloc.
+ *
+ * A block of the RUNNING thread goes back to its free lists, a block of another thread to that thread's list of
+ * remotely freed blocks, which it takes back on a later allocation. The latter is done in a critical section, so that
+ * the other thread is not terminated in the middle of it. ptr may be nullptr.
+*/
+void uthread_free(void *ptr);
+
+
+/*
+ * Synchronization objects. A thread that waits on one of them is BLOCKED: it leaves the READY threads list and
+ * does not run until it is woken, which puts it at the end of the READY threads list. Waiters are woken in the order
+ * they started waiting. uthread_resume does not wake a waiting thread, and a waiting thread that is also blocked with
+ * uthread_block stays BLOCKED until it is resumed. A thread terminated while waiting is removed from the wait queue.
+ * A waiting thread gives up the cpu, so the main thread may only wait while some other thread can run.
+ */
+
+/**
+ * @brief Initializes a free mutex, like UTHREAD_MUTEX_INITIALIZER.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_init(uthread_mutex_t *mutex);
+
+/**
+ * @brief Locks mutex, waiting while another thread holds it.
+ *
+ * It is an error to lock a mutex the calling thread already holds.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_lock(uthread_mutex_t *mutex);
+
+/**
+ * @brief Unlocks mutex, which the calling thread must hold.
+ *
+ * If threads wait on mutex it is handed directly to the first of them, which holds it by the time it runs again.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_unlock(uthread_mutex_t *mutex);
+
+/**
+ * @brief Initializes a condition variable with no waiters, like UTHREAD_COND_INITIALIZER.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_init(uthread_cond_t *cond);
+
+/**
+ * @brief Unlocks mutex and waits on cond, in one step. mutex is held again when the function returns.
+ *
+ * The calling thread must hold mutex.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex);
+
+/**
+ * @brief Wakes the first thread waiting on cond, if there is such. It then waits for its mutex.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_signal(uthread_cond_t *cond);
+
+/**
+ * @brief Wakes all the threads waiting on cond.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_broadcast(uthread_cond_t *cond);
+
+/**
+ * @brief Initializes a semaphore with the given non-negative value.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_init(uthread_sem_t *sem, int value);
+
+/**
+ * @brief Decrements sem, waiting while its value is 0.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_wait(uthread_sem_t *sem);
+
+/**
+ * @brief Increments sem. If threads wait on sem, the first of them is woken and takes the increment instead.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_post(uthread_sem_t *sem);
+
+
+/*
+ * Channels. A thread that sends to a full channel, or receives from an empty one, waits as with the synchronization
+ * objects above. The peer that matches a waiting thread copies the element to or from it directly and makes it
+ * READY, so the woken thread does not retry the operation. Waiters are matched in the order they started waiting.
+ */
+
+/**
+ * @brief Creates a channel of elements of elem_size bytes.
+ *
+ * capacity is the number of elements the channel buffers. With capacity 0 a send waits for a receive and the other
+ * way around. With UTHREAD_CHAN_UNBOUNDED a send never waits.
+ *
+ * @return On success, return the channel. On failure, return NULL.
+*/
+uthread_chan *uthread_chan_create(int elem_size, int capacity);
+
+/**
+ * @brief Destroys a channel no thread waits on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_destroy(uthread_chan *chan);
+
+/**
+ * @brief Sends a copy of the element at elem, waiting while the channel is full.
+ *
+ * It is an error to send to a closed channel, including one that was closed while the thread waited.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_send(uthread_chan *chan, const void *elem);
+
+/**
+ * @brief Receives an element into elem, waiting while the channel is empty.
+ *
+ * Once a closed channel has no more elements, the function stores zeros at elem and returns immediately.
+ *
+ * @return 1 if an element was received, 0 if the channel is closed and empty, -1 on failure.
+*/
+int uthread_chan_recv(uthread_chan *chan, void *elem);
+
+/**
+ * @brief Closes a channel. Waiting receivers get 0 from uthread_chan_recv, waiting senders fail.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_close(uthread_chan *chan);
+
+/**
+ * @brief Performs one of the n operations in cases, waiting until one of them can proceed.
+ *
+ * If several cases can proceed one of them is chosen, starting from a different case each call so that no case is
+ * starved. If nonblock is nonzero and no case can proceed, the function returns n instead of waiting.
+ * A send case of a closed channel is an error.
+ *
+ * @return The index of the case that was performed, n (see nonblock), or -1 on failure.
+*/
+int uthread_chan_select(uthread_chan_case *cases, int n, int nonblock);
+
+
+/*
+ * I/O. These wrappers make the fd non-blocking, and while the system call would block the calling thread waits for
+ * the fd to become ready, as with the synchronization objects above, and other threads run. The scheduler checks the
+ * fds threads wait on every few quantums, and when no thread is READY the process sleeps in epoll_wait until one of
+ * them is ready, instead of running a thread that only spins.
+ * An fd a thread waited on stays watched until it is closed with uthread_close. Closed with close(2) instead, the next
+ * file that gets the same fd number may not be watched, and threads waiting on it are never woken.
+ */
+
+/**
+ * @brief Reads up to count bytes from fd into buf, like read(2), without blocking the other threads.
+ *
+ * @return As read(2): the number of bytes read, 0 at end of file, or -1 with errno set.
+*/
+ssize_t uthread_read(int fd, void *buf, size_t count);
+
+/**
+ * @brief Writes up to count bytes from buf to fd, like write(2), without blocking the other threads.
+ *
+ * @return As write(2): the number of bytes written, or -1 with errno set.
+*/
+ssize_t uthread_write(int fd, const void *buf, size_t count);
+
+/**
+ * @brief Accepts a connection on the listening socket fd, like accept(2), without blocking the other threads.
+ *
+ * @return As accept(2): the fd of the accepted socket, or -1 with errno set.
+*/
+int uthread_accept(int fd, struct sockaddr *addr, socklen_t *addrlen);
+
+/**
+ * @brief Closes fd, like close(2), and stops watching it for the threads that wait for I/O.
+ *
+ * Threads waiting to read or write fd are woken, and their call fails with EBADF.
+ *
+ * @return As close(2): 0, or -1 with errno set.
+*/
+int uthread_close(int fd);
+
+
+/*
+ * Task pool. A fixed set of worker threads runs the submitted tasks in the order they were submitted, so a task
+ * costs no spawn and no stack of its own. A task may block like any thread, which holds its worker until it
+ * continues. Workers without a task wait, as with the synchronization objects above.
+ */
+
+/**
+ * @brief Creates a pool of the given number of worker threads, that run the tasks submitted to it.
+ *
+ * @return On success, return the pool. On failure, return NULL.
+*/
+uthread_pool *uthread_pool_create(int workers);
+
+/**
+ * @brief Destroys a pool. Waits until the tasks submitted to it have run and its workers terminated.
+ *
+ * It is an error to destroy a pool from one of its own tasks.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_pool_destroy(uthread_pool *pool);
+
+/**
+ * @brief Submits the task fn(arg) to a pool.
+ *
+ * It is an error to submit to a pool whose workers all stopped. A worker stops, with an error, when it has no task
+ * and no other thread is ready to submit one.
+ *
+ * @return On success, return the future of the value fn returns, which must be passed to uthread_future_get once.
+ * On failure, return NULL.
+*/
+uthread_future *uthread_pool_submit(uthread_pool *pool, void *(*fn)(void *), void *arg);
+
+/**
+ * @brief Waits until the task of future has run, and stores the value it returned in *ret if ret is not NULL.
+ *
+ * One thread may wait on a future. The future is freed when the function returns 0.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_future_get(uthread_future *future, void **ret);
+
+
+/*
+ * Stackless tasks. A stackless task runs a C++20 coroutine (see uthread_co_task below) as a thread without a stack
+ * of its own: it has an ID, is scheduled from the READY threads list like any thread, and is counted in max_threads.
+ * All stackless tasks run on a single stack of the library, so a task is not preempted and runs until it suspends.
+ * A task waits by suspending with co_await on the awaitables below, which call the functions of this section; a task
+ * that suspends on any other awaitable goes to the end of the READY threads list, as with uthread_yield. A task must
+ * not call the functions that wait or yield (uthread_yield, uthread_sleep, uthread_block of itself, and the waiting
+ * synchronization, channel, join, future and I/O functions), and ends by returning rather than with
+ * uthread_terminate. uthread_terminate of another task destroys its coroutine. Stackless tasks need a single worker,
+ * and can not be used in shared stack mode.
+ */
+
+/**
+ * @brief Creates a stackless task, that resume runs until the coroutine frame suspends, returning nonzero once the
+ * coroutine is done, and destroy deletes.
+ *
+ * @return On success, return the ID of the task. On failure, return -1.
+*/
+int uthread_co_spawn(void *frame, int (*resume)(void *), void (*destroy)(void *));
+
+/**
+ * @brief Allocates a coroutine frame of size bytes, safely while the caller may be preempted.
+ *
+ * A frame is freed by the task that runs it, so it can not come from the arena of the thread that spawns it.
+ *
+ * @return On success, return the frame. On failure, return NULL.
+*/
+void *uthread_co_frame_alloc(size_t size);
+
+/**
+ * @brief Frees a frame uthread_co_frame_alloc returned.
+*/
+void uthread_co_frame_free(void *frame);
+
+/**
+ * @brief Makes the RUNNING stackless task sleep for num_quantums quantums, as uthread_sleep, once it suspends.
+ *
+ * @return 1 if the task is to suspend, 0 if it is not (num_quantums is not positive), -1 on failure.
+*/
+int uthread_co_sleep(int num_quantums);
+
+/**
+ * @brief Sends elem to chan for the RUNNING stackless task, and stores what uthread_chan_send would return in *ret.
+ *
+ * If the send has to wait, the task is to suspend, and *ret is stored before it runs again. elem must stay valid
+ * until then.
+ *
+ * @return 1 if the task is to suspend, 0 if *ret was stored at once, -1 on failure.
+*/
+int uthread_co_chan_send(uthread_chan *chan, const void *elem, int *ret);
+
+/**
+ * @brief Receives from chan into elem for the RUNNING stackless task, and stores what uthread_chan_recv would
+ * return in *ret.
+ *
+ * If the receive has to wait, the task is to suspend, and elem and *ret are stored before it runs again.
+ *
+ * @return 1 if the task is to suspend, 0 if *ret was stored at once, -1 on failure.
+*/
+int uthread_co_chan_recv(uthread_chan *chan, void *elem, int *ret);
+
+/**
+ * @brief Makes the RUNNING stackless task wait until fd can be written (write nonzero) or read, once it suspends.
+ *
+ * As with uthread_read, the operation may still find nothing to do after the task was woken, and should be retried.
+ *
+ * @return 1 if the task is to suspend, 0 if fd is ready already, -1 on failure.
+*/
+int uthread_co_wait_fd(int fd, int write);
+
+
+#ifdef __cplusplus
+/* typed channel of T, which must be trivially copyable */
+template<typename T>
+class uthread_channel {
+ private:
+    uthread_chan *chan;
+ public:
+    explicit uthread_channel(int capacity = 0) : chan(uthread_chan_create(sizeof(T), capacity)) {}
+    ~uthread_channel() { uthread_chan_destroy(chan); }
+    uthread_channel(const uthread_channel &) = delete;
+    uthread_channel &operator=(const uthread_channel &) = delete;
+
+    int send(const T &elem) { return uthread_chan_send(chan, &elem); }
+    int recv(T &elem) { return uthread_chan_recv(chan, &elem); }
+    int close() { return uthread_chan_close(chan); }
+    uthread_chan *get() const { return chan; }
+#if __cplusplus >= 202002L
+    /* co_await recv() in a stackless task gives the element, or nothing once the channel is closed and empty */
+    struct recv_awaiter {
+        uthread_chan *chan;
+        T elem;
+        int ret;
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<>) { return uthread_co_chan_recv(chan, &elem, &ret) == 1; }
+        std::optional<T> await_resume() const
+        {
+            return ret == 1 ? std::optional<T>(elem) : std::nullopt;
+        }
+    };
+    recv_awaiter recv() { return {chan, T(), -1}; }
+
+    /* co_await co_send(elem) in a stackless task gives whether elem was sent */
+    struct send_awaiter {
+        uthread_chan *chan;
+        T elem;
+        int ret;
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<>) { return uthread_co_chan_send(chan, &elem, &ret) == 1; }
+        bool await_resume() const { return ret == 0; }
+    };
+    send_awaiter co_send(const T &elem) { return {chan, elem, -1}; }
+#endif
+};
+
+/* task pool that runs closures returning void *, each copied to the heap until it has run */
+class uthread_task_pool {
+ private:
+    uthread_pool *pool;
+
+    template<typename F>
+    static void *run(void *arg)
+    {
+        F *fn = (F *) arg;
+        void *result = (*fn)();
+        delete fn;
+        return result;
+    }
+ public:
+    explicit uthread_task_pool(int workers) : pool(uthread_pool_create(workers)) {}
+    ~uthread_task_pool() { uthread_pool_destroy(pool); }
+    uthread_task_pool(const uthread_task_pool &) = delete;
+    uthread_task_pool &operator=(const uthread_task_pool &) = delete;
+
+    template<typename F>
+    uthread_future *submit(F fn)
+    {
+        F *boxed = new F(static_cast<F &&>(fn));
+        uthread_future *future = uthread_pool_submit(pool, &run<F>, boxed);
+        if (future == nullptr)
+        {
+            delete boxed;
+        }
+        return future;
+    }
+    uthread_pool *get() const { return pool; }
+};
+
+#if __cplusplus >= 202002L
+/* coroutine of a stackless task. calling the coroutine creates the task, and spawn schedules it */
+class uthread_co_task {
+ public:
+    struct promise_type {
+        uthread_co_task get_return_object()
+        {
+            return uthread_co_task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        static void *operator new(size_t size) noexcept { return uthread_co_frame_alloc(size); }
+        static void operator delete(void *frame) { uthread_co_frame_free(frame); }
+        static uthread_co_task get_return_object_on_allocation_failure() { return uthread_co_task(nullptr); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    uthread_co_task(uthread_co_task &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    ~uthread_co_task()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+    uthread_co_task(const uthread_co_task &) = delete;
+    uthread_co_task &operator=(const uthread_co_task &) = delete;
+
+    /* @return the ID of the task, which owns the coroutine from now on, or -1 on failure */
+    int spawn()
+    {
+        int tid = uthread_co_spawn(handle.address(), &resume, &destroy);
+        if (tid != -1)
+        {
+            handle = nullptr;
+        }
+        return tid;
+    }
+
+ private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit uthread_co_task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    static int resume(void *frame)
+    {
+        std::coroutine_handle<> h = std::coroutine_handle<>::from_address(frame);
+        h.resume();
+        return h.done();
+    }
+    static void destroy(void *frame) { std::coroutine_handle<>::from_address(frame).destroy(); }
+};
+
+/* co_await in a stackless task sleeps for quantums quantums */
+struct uthread_sleep_for {
+    int quantums;
+    explicit uthread_sleep_for(int quantums) : quantums(quantums) {}
+    bool await_ready() const noexcept { return quantums <= 0; }
+    bool await_suspend(std::coroutine_handle<>) { return uthread_co_sleep(quantums) == 1; }
+    void await_resume() const noexcept {}
+};
+
+/* co_await in a stackless task waits until fd can be read (uthread_fd_readable) or written (uthread_fd_writable) */
+struct uthread_fd_wait {
+    int fd;
+    int write;
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<>) { return uthread_co_wait_fd(fd, write) == 1; }
+    void await_resume() const noexcept {}
+};
+inline uthread_fd_wait uthread_fd_readable(int fd) { return {fd, 0}; }
+inline uthread_fd_wait uthread_fd_writable(int fd) { return {fd, 1}; }
+#endif
+#endif
 
 #endif